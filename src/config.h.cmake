@@ -25,4 +25,7 @@
 // should we use Intel MKL through Eigen?
 #cmakedefine EIGEN_USE_MKL_ALL
 
+// should sparse matrices use 64-bit indices?
+#cmakedefine HPCA_64BIT_INDEX
+
 #endif // CONFIG_H
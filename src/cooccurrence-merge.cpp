@@ -0,0 +1,299 @@
+// This tools merges partial cooccurrence counts into the final statistics.
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// include utility headers
+#include "util/data.h"
+#include "util/constants.h"
+#include "util/convert.h"
+#include "util/util.h"
+#include "util/spill.h"
+
+int verbose = true; // true or false
+std::string input_dir_names;
+char *c_output_dir_name;
+char *c_vocab_file_name;
+float min_pair_count = 0; // drop pairs counted less than this from the final matrix
+int top_k = 0; // keep only the top-k contexts of each target word, 0 to keep them all
+
+/* options which must be the same for every partial count */
+const char *SHARED_OPTIONS[] = {"VOCAB_CRC32", "VOCAB_MIN_COUNT", "CXT_CRC32",
+                                "CONTEXT_VOCAB_UPPER_BOUND_FREQ", "CONTEXT_VOCAB_LOWER_BOUND_FREQ",
+                                "DYN_CXT", "WINDOW_SIZE", "SAMPLE", "HASH_CXT", "HASH_SIGN", "CONTEXT_COLUMNS"};
+
+/* check that partial counts can be merged together */
+void check_partials(const std::vector<std::string> &dirs, std::vector< std::map<std::string, std::string> > &options){
+    // shards of every corpus file, with the number of shards it is split into
+    std::map<std::string, std::set<int> > shards;
+    std::map<std::string, int> splits;
+    for (size_t d=0; d<dirs.size(); d++){
+        char *c_options_file_name = get_full_path(dirs[d].c_str(), "options.txt");
+        char *c_part_file_name = get_full_path(dirs[d].c_str(), "cooccurrence.part");
+        is_file(c_options_file_name);
+        is_file(c_part_file_name);
+        options.push_back(read_options(c_options_file_name));
+        std::map<std::string, std::string> &opt = options.back();
+        if ( opt["PARTIAL"] != "1" ){
+            throw std::runtime_error(dirs[d] + " does not contain a partial count !!");
+        }
+        for (size_t o=0; o<sizeof(SHARED_OPTIONS)/sizeof(char*); o++){
+            if ( opt[SHARED_OPTIONS[o]] != options[0][SHARED_OPTIONS[o]] ){
+                throw std::runtime_error(std::string(SHARED_OPTIONS[o]) + " differs between " + dirs[0] + " and " + dirs[d] + " !!");
+            }
+        }
+        if ( (opt["CXT_FILE"] == "none") != (options[0]["CXT_FILE"] == "none") ){
+            throw std::runtime_error("context vocabulary differs between " + dirs[0] + " and " + dirs[d] + " !!");
+        }
+        // the same part of a corpus must not be counted twice, a full count is a single shard
+        int shard_id = 0, num_shards = 1;
+        if ( !opt["SHARD"].empty() && (sscanf(opt["SHARD"].c_str(), "%d/%d", &shard_id, &num_shards) != 2
+                                       || num_shards < 1 || shard_id < 0 || shard_id >= num_shards) ){
+            throw std::runtime_error("invalid shard " + opt["SHARD"] + " in " + dirs[d] + " !!");
+        }
+        const std::string &corpus = opt["CORPUS_FILE"];
+        if ( splits.count(corpus) && splits[corpus] != num_shards ){
+            if ( splits[corpus] == 1 || num_shards == 1 ){
+                throw std::runtime_error("a full partial count of " + corpus + " cannot be merged with its shards !!");
+            }
+            throw std::runtime_error("shards of " + corpus + " come from splits into " + typeToString(splits[corpus]) + " and " + typeToString(num_shards) + " parts !!");
+        }
+        splits[corpus] = num_shards;
+        if ( !shards[corpus].insert(shard_id).second ){
+            throw std::runtime_error("shard " + opt["SHARD"] + " of " + corpus + " is given twice !!");
+        }
+        free(c_options_file_name);
+        free(c_part_file_name);
+    }
+    // every shard of a corpus must be merged, ids are unique and lower than the number of shards
+    for (std::map<std::string, int>::const_iterator it=splits.begin(); it!=splits.end(); ++it){
+        const std::set<int> &ids = shards[it->first];
+        for (int k=0; (int)ids.size() < it->second && k < it->second; k++){
+            if ( !ids.count(k) ){
+                throw std::runtime_error("shard " + typeToString(k) + "/" + typeToString(it->second) + " of " + it->first + " is missing !!");
+            }
+        }
+    }
+    if ( strtoul(options[0]["VOCAB_CRC32"].c_str(), NULL, 10) != file_crc32(c_vocab_file_name) ){
+        throw std::runtime_error("partial counts have not been computed with " + std::string(c_vocab_file_name) + " !!");
+    }
+}
+
+/* merge partial counts */
+int merge_partials(const std::vector<std::string> &dirs, int *tokenfound, const int num_columns){
+    const int num = dirs.size();
+    unsigned long long nbytes = 0;
+    spill_reader_t **fid = (spill_reader_t**)calloc(num, sizeof(spill_reader_t*));
+    for (int i=0; i<num; i++){
+        char *c_part_file_name = get_full_path(dirs[i].c_str(), "cooccurrence.part");
+        fid[i] = spill_open_reader(c_part_file_name);
+        if (fid[i] == NULL){
+            throw std::runtime_error("Unable to open file " + std::string(c_part_file_name) + " !!");
+        }
+        nbytes += get_file_size(c_part_file_name);
+        free(c_part_file_name);
+    }
+    char *c_output_file_name = get_full_path(c_output_dir_name, "cooccurrence.bin");
+    csr_writer_t *fout = csr_open_writer(c_output_file_name, min_pair_count, top_k, 0, num_columns);
+    if (verbose) fprintf(stderr,"\033[0Gmerging %3d partial files (%.1f MB on disk): processed 0 cooccurrences.", num, (float)nbytes/MEGAOCTET);
+    const unsigned long long counter = spill_merge(fid, num, fout, NULL, tokenfound, NULL, verbose);
+    const unsigned long long nnz = csr_close_writer(fout);
+    if (counter == 0){
+        throw std::runtime_error("no cooccurrence found in partial counts!!");
+    }
+    char *c_index_file_name = get_full_path(c_output_dir_name, "cooccurrence.idx");
+    csr_write_index(c_output_file_name, c_index_file_name);
+    free(c_index_file_name);
+    if (verbose){
+        fprintf(stderr,"\033[0Gmerging %3d partial files (%.1f MB on disk): processed %llu cooccurrences.\n", num, (float)nbytes/MEGAOCTET, counter);
+        if (nnz < counter) fprintf(stderr,"%llu cooccurrences kept after truncation (%.1f%%).\n", nnz, 100.0*nnz/counter);
+        fprintf(stderr,"done, all cooccurrences saved in file %s.\n", c_output_file_name);
+    }
+    for (int i=0; i<num; i++) spill_close_reader(fid[i]);
+    free(fid);
+    free(c_output_file_name);
+    return 0;
+}
+
+/* get the number of tokens in vocabulary */
+int get_vocab_size(){
+    char token[MAX_TOKEN];
+    unsigned long long freq;
+    int vocab_size=0;
+    FILE *fp = fopen(c_vocab_file_name, "r");
+    while(fscanf(fp, "%s %llu\n", token, &freq) != EOF) vocab_size++;
+    fclose(fp);
+    return vocab_size;
+}
+
+/* write out target words, in the order of the vocabulary */
+void write_target_words(const int *tokenfound, const int vocab_size){
+    char token[MAX_TOKEN];
+    unsigned long long freq;
+    int i=0;
+    char *c_output_word_name = get_full_path(c_output_dir_name, "target_words.txt");
+    if (verbose) fprintf(stderr, "writing target words vocabulary in %s\n", c_output_word_name);
+    FILE *fp = fopen(c_vocab_file_name, "r");
+    FILE *fw = fopen(c_output_word_name, "w");
+    while(i<vocab_size && fscanf(fp, "%s %llu\n", token, &freq) != EOF){
+        if (tokenfound[i++]) fprintf(fw, "%s\n", token);
+    }
+    fclose(fw);
+    fclose(fp);
+    free(c_output_word_name);
+}
+
+/* copy context words and options of the first partial count */
+void write_context_and_options(const std::vector<std::string> &dirs, std::vector< std::map<std::string, std::string> > &options){
+    std::string line;
+    // context words do not depend on counts
+    char *c_input_context_name = get_full_path(dirs[0].c_str(), "context_words.txt");
+    std::ifstream ifc(c_input_context_name);
+    if ( !ifc.fail() ){
+        std::string content((std::istreambuf_iterator<char>(ifc)), std::istreambuf_iterator<char>());
+        ifc.close();
+        char *c_output_context_name = get_full_path(c_output_dir_name, "context_words.txt");
+        if (verbose) fprintf(stderr, "writing context words vocabulary in %s\n", c_output_context_name);
+        std::ofstream ofc(c_output_context_name);
+        ofc << content;
+        free(c_output_context_name);
+    }
+    free(c_input_context_name);
+
+    // list every corpus file counted
+    std::string corpus_files;
+    std::set<std::string> seen;
+    for (size_t d=0; d<options.size(); d++){
+        if ( seen.insert(options[d]["CORPUS_FILE"]).second ){
+            if ( !corpus_files.empty() ) corpus_files += ",";
+            corpus_files += options[d]["CORPUS_FILE"];
+        }
+    }
+    // options of the first partial count, without partial fields
+    char *c_input_options_name = get_full_path(dirs[0].c_str(), "options.txt");
+    std::ifstream ifo(c_input_options_name);
+    std::string content;
+    while ( getline(ifo, line) ){
+        if ( line.compare(0, 8, "PARTIAL=") == 0 || line.compare(0, 6, "SHARD=") == 0 ) continue;
+        if ( line.compare(0, 15, "MIN_PAIR_COUNT=") == 0 || line.compare(0, 6, "TOP_K=") == 0 ) continue;
+        if ( line.compare(0, 8, "EXP_DIR=") == 0 ) line = "EXP_DIR=" + std::string(c_output_dir_name);
+        if ( line.compare(0, 12, "CORPUS_FILE=") == 0 ) line = "CORPUS_FILE=" + corpus_files;
+        content += line + "\n";
+    }
+    ifo.close();
+    // truncation is only applied by the merge
+    content += "MIN_PAIR_COUNT=" + typeToString(min_pair_count) + "\n";
+    content += "TOP_K=" + typeToString(top_k) + "\n";
+    char *c_output_options_name = get_full_path(c_output_dir_name, "options.txt");
+    std::ofstream ofo(c_output_options_name);
+    ofo << content;
+    free(c_input_options_name);
+    free(c_output_options_name);
+}
+
+int main(int argc, char **argv) {
+    int i;
+    c_vocab_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
+    c_output_dir_name = (char*)malloc(sizeof(char) * MAX_PATH_NAME);
+
+    if (argc == 1) {
+        printf("HPCA: Hellinger PCA for Word Embeddings, merge partial co-occurrence counts\n");
+        printf("Author: Remi Lebret (remi@lebret.ch)\n\n");
+        printf("Usage options:\n");
+        printf("\t-verbose <int>\n");
+        printf("\t\tSet verbosity: 0=off or 1=on (default)\n");
+        printf("\t-input-dirs <dir>[,<dir>...]\n");
+        printf("\t\tDirectories containing partial counts, as saved by cooccurrence with -partial 1 or -shard i/n,\n");
+        printf("\t\twith every shard of a file split into n, and no full count of a file mixed with its shards\n");
+        printf("\t-vocab-file <file>\n");
+        printf("\t\tVocabulary file used by every partial count\n");
+        printf("\t-output-dir <dir>\n");
+        printf("\t\tOutput directory name to save files\n");
+        printf("\t-min-pair-count <float>\n");
+        printf("\t\tDrop pairs counted less than this value from the final matrix, row sums still include them; default is 0 (keep all)\n");
+        printf("\t-top-k <int>\n");
+        printf("\t\tKeep only the k most frequent contexts of each target word, row sums still include the others; default is 0 (keep all)\n");
+        printf("\nExample usage:\n");
+        printf("./cooccurrence-merge -input-dirs part0,part1,part2,part3 -vocab-file vocab.txt -output-dir path_to_dir -verbose 1\n\n");
+        return 0;
+    }
+
+    if (verbose){
+        fprintf(stderr, "HPCA: Hellinger PCA for Word Embeddings\n");
+        fprintf(stderr, "Author: Remi Lebret (remi@lebret.ch)\n");
+        fprintf(stderr, "---------------------------------------\n");
+        fprintf(stderr, "merge partial co-occurrence counts\n" );
+        fprintf(stderr, "---------------------------------------\n\n");
+    }
+
+    if ((i = find_arg((char *)"-verbose", argc, argv)) > 0) verbose = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-input-dirs", argc, argv)) > 0) input_dir_names = argv[i + 1];
+    if ((i = find_arg((char *)"-output-dir", argc, argv)) > 0) strcpy(c_output_dir_name, argv[i + 1]);
+    else strcpy(c_output_dir_name, (char *)".");
+    if ((i = find_arg((char *)"-vocab-file", argc, argv)) > 0) strcpy(c_vocab_file_name, argv[i + 1]);
+    else strcpy(c_vocab_file_name, (char *)"vocab.txt");
+    if ((i = find_arg((char *)"-min-pair-count", argc, argv)) > 0) min_pair_count = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-top-k", argc, argv)) > 0) top_k = atoi(argv[i + 1]);
+    if ( min_pair_count<0 || top_k<0 ){
+        throw std::runtime_error("-min-pair-count and -top-k must be positive values !!");
+    }
+
+    /* check whether output directory exists */
+    is_directory(c_output_dir_name);
+    /* check whether vocab file exists */
+    is_file(c_vocab_file_name);
+    const std::vector<std::string> dirs = split(input_dir_names, ',');
+    if ( dirs.empty() ){
+        throw std::runtime_error("-input-dirs cannot be empty !!");
+    }
+    for (size_t d=0; d<dirs.size(); d++) is_directory(dirs[d].c_str());
+
+    /* check partial counts */
+    std::vector< std::map<std::string, std::string> > options;
+    check_partials(dirs, options);
+
+    /* merge */
+    const int vocab_size = get_vocab_size();
+    int *tokenfound = (int*)calloc(vocab_size, sizeof(int));
+    // partial counts of earlier versions only record hashed columns
+    const std::string columns = (options[0]["CONTEXT_COLUMNS"].empty()) ? options[0]["HASH_CXT"] : options[0]["CONTEXT_COLUMNS"];
+    merge_partials(dirs, tokenfound, atoi(columns.c_str()));
+
+    /* write vocabularies and options */
+    write_target_words(tokenfound, vocab_size);
+    write_context_and_options(dirs, options);
+
+    /* release memory */
+    free(tokenfound);
+    free(c_vocab_file_name);
+    free(c_output_dir_name);
+
+    if (verbose){
+        fprintf(stderr, "\ndone\n");
+        fprintf(stderr, "---------------------------------------\n");
+    }
+    return 0;
+}
@@ -19,8 +19,18 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstdarg>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <queue>
+#include <sstream>
 #include <stdexcept>
+#include <pthread.h>
+#include <vector>
 
 // include utility headers
 #include "util/data.h"
@@ -30,133 +40,341 @@
 #include "util/file.h"
 #include "util/util.h"
 #include "util/hashtable.h"
+#include "util/spill.h"
 
 int verbose = true; // true or false
-int dyn_cxt = false; // true or false
 int min_freq = 100; // keep words appearing at least min_freq times
-char *c_input_file_name, *c_output_dir_name, *c_output_file_name;
-char *c_vocab_file_name, *c_context_file_name;
+char *c_input_file_name, *c_output_dir_name;
+std::vector<std::string> tmp_dirs; // scratch directories for spill runs, -output-dir if empty
+int num_tmp_dirs = 1;
+char *c_vocab_file_name, *c_context_file_name, *c_target_file_name;
 int predefined_context=0;
+int predefined_target=0;
+int num_targets=0;
 int vocab_size=0;
-long int ntoken=0;
+long long ntoken=0;
 float upper_bound=1.0;
 float lower_bound=0.00001;
 int Wid=0;
 int Cid_upper=0;
 int Cid_lower=0;
-int cxt_size=5;
 int num_threads = 8; // pthreads
-float memory_limit = 4.0; // soft limit, in gigabytes, used to estimate optimal array sizes
-unsigned long long max_cooccur_size;
+float memory_limit = 4.0; // limit, in gigabytes, buffers are resized to hold it
+// memory accountant
+unsigned long long memory_ceiling = 0; // in bytes
+unsigned long long base_memory = 0; // used besides accumulator buffers
+unsigned long long buffer_memory = 0, peak_buffer_memory = 0; // allocated by accumulator buffers
+unsigned long long peak_process_memory = 0; // highest resident memory observed
+pthread_mutex_t memory_lock = PTHREAD_MUTEX_INITIALIZER;
+int compress_tmp = 0; // deflate temporary files on top of the varint encoding
+int update = 0; // merge new counts into an existing output directory
+int resume = 0; // resume an interrupted run from its manifest
+int partial = 0; // write a partial count to be merged with cooccurrence-merge
+int shard_id = 0, num_shards = 1; // count only a byte range of the corpus
+float sample = 0; // threshold for subsampling frequent words, 0 to keep every token
+int symmetric = 0; // record pairs of target/context words once, mirrored when merging
+float min_pair_count = 0; // drop pairs counted less than this from the final matrix
+int top_k = 0; // keep only the top-k contexts of each target word, 0 to keep them all
+int hash_cxt = 0; // number of hashed context columns, 0 for one column per context word
+int hash_sign = 0; // hashed contexts are added with a random sign
+float sketch_threshold = 0; // count exactly only the pairs whose sketched count reaches it, 0 for exact counts
+int sketch_pass = 0; // current pass over the corpus in sketch mode
+pthread_mutex_t sketch_lock = PTHREAD_MUTEX_INITIALIZER;
+unsigned int *sample_keep = NULL; // per token, probability of being kept scaled to 2^32
+unsigned long vocab_crc=0, cxt_crc=0, target_crc=0; // checksums of the vocabularies
 // variable for handling vocab
-vocab hash;
-sparse_hash_map<unsigned int,unsigned int> context;
+vocab_ids hash;
+int * cxt_map; // dense token id -> context column (-1 if not a context)
+int * cxt_inv; // context column -> dense token id (predefined context)
+float * cxt_sign = NULL; // dense token id -> sign of its hashed column
+int * target_map = NULL; // dense token id -> row (-1 if not a target), predefined targets
+int * target_inv = NULL; // row -> dense token id (predefined targets)
+unsigned int cxt_span; // number of context columns - 1 (bound-based context)
+int num_contexts = 0; // size of the context vocabulary
 char ** tokename;
-int * tokenfound;
-int * nfile;
+// manifest of completed work, used to resume an interrupted run
+FILE *manifest = NULL;
+char *c_manifest_file_name;
+pthread_mutex_t manifest_lock = PTHREAD_MUTEX_INITIALIZER;
 
-/* Merge [num] sorted files of cooccurrence records */
-int merge_files(const int nbthread) {
-    int i=0, size;
-    long long counter = 0;
-    cooccur_id_t *pq=NULL, new_id, old_id;
-    FILE **fid = NULL;
-    // get total number of files
+// exact counts of pairs of words, keyed by (target << 32 | context column)
+typedef sparse_hash_map<unsigned long long, float> pair_map;
+
+struct window;
+typedef unsigned long long (*getcontext_t)(cooccur_t*, unsigned long long, const unsigned int*, const int, const int, const window*);
+
+/**
+ * a window configuration, all configurations are counted
+ * from the same token stream
+ **/
+struct window {
+    int cxt_size; // symmetric context size
+    int dyn_cxt; // weighting by distance form the focus word
+    char *output_dir_name;
+    char *output_file_name;
+    char **tmp_file_names; // per scratch directory, base name of spill runs
+    float weights[MAX_CXT_SIZE+1]; // weight for each distance to the focus word
+    getcontext_t kernel;
+    unsigned long long max_cooccur_size; // per thread, initial size of both buffers
+    unsigned long long min_buffer_size; // bounds for resizing a buffer
+    unsigned long long max_buffer_size;
+    int *tokenfound;
+    int *nfile;
+    cooccur_t **mem_runs; // per thread, last sorted buffer kept in memory
+    unsigned long long *mem_length; // number of records of these buffers
+    unsigned long long *mem_capacity; // their accounted size
+    long int *resume_pos; // per thread, line from which counting resumes
+    int *resume_j; // per thread, token of that line from which counting resumes
+    int merged; // final files already written
+    int merging; // merged counts complete in the manifest, cooccurrences must not be merged again
+    char *corpus_files; // corpus files already counted in this directory
+    // sketch mode
+    unsigned int *sketch; // count-min sketch of the pairs, SKETCH_DEPTH rows of sketch_width counters
+    unsigned long long sketch_width;
+    unsigned int sketch_scale; // counters hold values times this scale
+    double *row_sums; // exact sum of every row
+    double sketch_total; // sum of every record
+    unsigned long long heavy_limit; // per thread, pairs counted exactly before they are spilled
+    unsigned long long sketch_candidates; // number of these pairs
+    double sketch_mean_error; // mean overestimation of their sketched counts
+};
+typedef window window_t;
+
+/* whether records hold positive integer counts */
+inline int integer_counts(const window_t *win){
+    return !win->dyn_cxt && !hash_sign;
+}
+window_t *windows;
+int num_windows=0;
+
+int mirror_record(const cooccur_t *record, cooccur_t *mirrored);
+void remove_runs(const window_t *win, const int tid, int k);
+void write_manifest(const char *format, ...);
+
+/* name of the k-th spill run of a thread, runs are striped across scratch directories */
+void run_file_name(char *name, const window_t *win, const int tid, const int k){
+    sprintf(name, "%s-%d_%04d.bin", win->tmp_file_names[(tid+k)%num_tmp_dirs], tid, k);
+}
+
+/* get the number of sorted runs of the threads, on disk and in memory */
+int count_runs(const window_t *win, const int nbthread){
     int num=0;
-    for (int f=0; f<nbthread; f++) num += nfile[f];
-    char tmp_output_file_name[MAX_FULLPATH_NAME];
-    // allocation
-    fid = (FILE**)calloc(num, sizeof(FILE*));
-    pq = (cooccur_id_t*)malloc(num * sizeof(cooccur_id_t));
+    for (int f=0; f<nbthread; f++) num += win->nfile[f] + (win->mem_length[f]>0);
+    return num;
+}
 
-    // define final output file
-    sprintf(tmp_output_file_name,"%s.bin",c_output_file_name);
-    FILE *fout = fopen(tmp_output_file_name,"wb");;
-    if (verbose)  fprintf(stderr,"\n\033[0Gmerging %3d cooccurrence files: processed 0 cooccurrences.", num);
+/* open the sorted runs of the threads, on disk and in memory, from fid[i] */
+int open_runs(const window_t *win, const int nbthread, spill_reader_t **fid, int i, unsigned long long *nbytes){
+    char c_run_file_name[MAX_FULLPATH_NAME];
+    for (int f=0; f<nbthread; f++){
+        for (int k=0; k<win->nfile[f]; k++){
+            run_file_name(c_run_file_name, win, f, k);
+            fid[i] = spill_open_reader(c_run_file_name);
+            if (fid[i] == NULL) throw std::runtime_error("Unable to open file " + std::string(c_run_file_name) + " !!");
+            *nbytes += get_file_size(c_run_file_name);
+            i++;
+        }
+        if (win->mem_length[f]>0) fid[i++] = spill_open_memory_reader(win->mem_runs[f], win->mem_length[f]);
+    }
+    return i;
+}
 
-    /* Open all files and add first entry of each to priority queue */
+/* release the runs kept in memory once merged */
+void release_memory_runs(window_t *win, const int nbthread){
     for (int f=0; f<nbthread; f++){
-        const int nf = nfile[f];
-        for(int k= 0; k < nf; k++) {
-            // get temporary file name
-            sprintf(tmp_output_file_name,"%s-%d_%04d.bin",c_output_file_name, f, k);
-            fid[i] = fopen(tmp_output_file_name,"rb");
-            if(fid[i] == NULL) {fprintf(stderr, "Unable to open file %s.\n",tmp_output_file_name); return 1;}
-            fread(&new_id, sizeof(cooccur_t), 1, fid[i]);
-            new_id.id = i;
-            insert_pq(pq,new_id,++i);
-        }
-    }
-
-    /* Pop top node, save it in old to see if the next entry is a duplicate */
-    size = num;
-    old_id = pq[0];
-    i = pq[0].id;
-    delete_pq(pq, size);
-    fread(&new_id, sizeof(cooccur_t), 1, fid[i]);
-    if(feof(fid[i])) size--;
-    else {
-        new_id.id = i;
-        insert_pq(pq, new_id, size);
-    }
-
-    /* Repeatedly pop top node and fill priority queue until files have reached EOF */
-    while(size > 0) {
-        if (!tokenfound[old_id.idx1]) tokenfound[old_id.idx1]=true; // set this token has found
-        counter += merge_write(pq[0], &old_id, fout); // Only count the lines written to file, not duplicates
-        if((counter%100000) == 0) if(verbose) fprintf(stderr,"\033[43G%lld cooccurrences.",counter);
-        i = pq[0].id;
-
-        delete_pq(pq, size);
-        fread(&new_id, sizeof(cooccur_t), 1, fid[i]);
-        if(feof(fid[i])) size--;
-        else {
-            new_id.id = i;
-            insert_pq(pq, new_id, size);
-        }
-    }
-    if (!tokenfound[old_id.idx1]) tokenfound[old_id.idx1]=true; // set this token has found
-    fwrite(&old_id, sizeof(cooccur_t), 1, fout);
-    fclose(fout);
+        if (win->mem_runs[f] == NULL) continue;
+        free(win->mem_runs[f]);
+        win->mem_runs[f] = NULL;
+        win->mem_length[f] = 0;
+        pthread_mutex_lock(&memory_lock);
+        buffer_memory -= sizeof(cooccur_t)*win->mem_capacity[f];
+        pthread_mutex_unlock(&memory_lock);
+    }
+}
+
+/* number of columns of the matrix, the same as the context vocabulary whatever pairs are found or kept */
+inline int num_columns(){
+    return (hash_cxt) ? hash_cxt : num_contexts;
+}
+
+/* Merge [num] sorted files of cooccurrence records */
+int merge_files(window_t *win, const int nbthread) {
+    const char *c_output_file_name = win->output_file_name;
+    int *nfile = win->nfile;
+    int i=0;
+    unsigned long long counter = 0;
+    unsigned long long nbytes = 0;
+    unsigned long long nnz = 0;
+    spill_reader_t **fid = NULL;
+    spill_writer_t *fpart = NULL;
+    csr_writer_t *fout = NULL;
+    spill_mirror_t mirror;
+    char c_mirror_prefix[MAX_FULLPATH_NAME];
+    int num = 0;
+    char tmp_output_file_name[MAX_FULLPATH_NAME];
+    char c_final_file_name[MAX_FULLPATH_NAME], c_merged_file_name[MAX_FULLPATH_NAME];
+
+    // define final output file, written aside when it is also an input
+    sprintf(c_final_file_name,(partial) ? "%s.part" : "%s.bin",c_output_file_name);
+    sprintf(c_merged_file_name,(update) ? "%s.bin.tmp" : "%s",c_final_file_name);
+
+    if (win->merging){
+        // an interrupted update already merged the runs, the matrix is either aside or in place
+        if (access(c_merged_file_name, F_OK) == 0 && rename(c_merged_file_name, c_final_file_name) != 0){
+            throw std::runtime_error("Unable to replace file " + std::string(c_final_file_name) + " !!");
+        }
+        // get back the target words found
+        if (!partial){
+            csr_reader_t *cr = csr_open_reader(c_final_file_name);
+            if (cr == NULL) throw std::runtime_error("Unable to open file " + std::string(c_final_file_name) + " !!");
+            cooccur_t rec;
+            while (csr_read(cr, &rec)){ win->tokenfound[rec.idx1] = 1; counter++; }
+            csr_close_reader(cr);
+        }
+        nnz = counter;
+    }else{
+        // get total number of files
+        num = count_runs(win, nbthread);
+        if (update) num++; // existing cooccurrences
+        // allocation
+        fid = (spill_reader_t**)calloc(num, sizeof(spill_reader_t*));
+
+        long long headroom = (long long)(0.9*memory_ceiling) - (long long)(base_memory + buffer_memory);
+        if (symmetric){ // symmetric records are mirrored while merging, mirrors wait for their row in half of the memory left
+            sprintf(c_mirror_prefix, "%s-mirror", win->tmp_file_names[0]);
+            mirror.mirror = mirror_record;
+            mirror.first = (update) ? 1 : 0; // existing cooccurrences are already mirrored
+            mirror.capacity = (headroom>0) ? headroom/(2*sizeof(cooccur_id_t)) : 0;
+            if (mirror.capacity < win->max_cooccur_size) mirror.capacity = win->max_cooccur_size; // counting buffers are released
+            mirror.prefix = c_mirror_prefix;
+            mirror.integer = integer_counts(win);
+            mirror.codec = compress_tmp;
+            headroom /= 2;
+        }
+        if (partial){ // sorted run to be merged with other partial counts
+            fpart = spill_open_writer(c_merged_file_name, integer_counts(win), compress_tmp);
+        }else{
+            // entries are written at once if they fit in the memory left
+            fout = csr_open_writer(c_merged_file_name, min_pair_count, top_k, (headroom>0) ? headroom : 0, num_columns());
+        }
+        if (verbose)  fprintf(stderr,"\n");
+
+        /* existing cooccurrences are merged as an additional sorted run */
+        if (update){
+            fid[i] = spill_open_cooccurrence_reader(c_final_file_name);
+            if(fid[i] == NULL) {fprintf(stderr, "Unable to open file %s.\n",c_final_file_name); return 1;}
+            nbytes += get_file_size(c_final_file_name);
+            i++;
+        }
+
+        /* Open all files */
+        i = open_runs(win, nbthread, fid, i, &nbytes);
+        if (verbose) fprintf(stderr,"\033[0Gmerging %3d cooccurrence files (%.1f MB on disk): processed 0 cooccurrences.", num, (float)nbytes/MEGAOCTET);
+
+        /* merge all sorted runs */
+        counter = spill_merge(fid, num, fout, fpart, win->tokenfound, (symmetric) ? &mirror : NULL, verbose);
+        if (counter == 0){
+            throw std::runtime_error("no cooccurrence found in the corpus!!");
+        }
+        nnz = counter;
+        if (fpart) spill_close_writer(fpart);
+        else nnz = csr_close_writer(fout);
+        for (i=0; i<num; i++) spill_close_reader(fid[i]);
+        free(fid);
+        if (update){
+            // from now on, the runs are in the merged matrix and must not be merged again
+            write_manifest("MERGING %d\n", (int)(win - windows));
+            if (rename(c_merged_file_name, c_final_file_name) != 0){
+                throw std::runtime_error("Unable to replace file " + std::string(c_final_file_name) + " !!");
+            }
+        }
+    }
+    if (!partial){ // row offsets for random access
+        char c_index_file_name[MAX_FULLPATH_NAME];
+        sprintf(c_index_file_name,"%s.idx",c_output_file_name);
+        csr_write_index(c_final_file_name, c_index_file_name);
+    }
     if (verbose){
-        fprintf(stderr,"\033[0Gmerging %3d cooccurrence files: processed %lld cooccurrences.\n",num, ++counter);
-        fprintf(stderr,"done, all cooccurrences saved in file %s.bin.\n", c_output_file_name);
+        if (win->merging) fprintf(stderr,"\ncooccurrences already merged by the interrupted run: %llu cooccurrences.\n", counter);
+        else fprintf(stderr,"\033[0Gmerging %3d cooccurrence files (%.1f MB on disk): processed %llu cooccurrences.\n",num, (float)nbytes/MEGAOCTET, counter);
+        if (nnz < counter) fprintf(stderr,"%llu cooccurrences kept after truncation (%.1f%%).\n", nnz, 100.0*nnz/counter);
+        fprintf(stderr,"done, all cooccurrences saved in file %s.\n", c_final_file_name);
     }
     // removing temporary files
-    i=0;
+    release_memory_runs(win, nbthread);
     for (int f=0; f<nbthread; f++){
         const int nf = nfile[f];
         for(int k= 0; k < nf; k++) {
-            sprintf(tmp_output_file_name,"%s-%d_%04d.bin",c_output_file_name, f, k);
-            fclose(fid[i++]);
+            run_file_name(tmp_output_file_name, win, f, k);
             remove(tmp_output_file_name);
         }
     }
 
-    // release memory
-    free(fid);
-    free(pq);
-
     return 0;
 }
 
+/* murmur3 finalizer, mix the bits of a 64-bit integer */
+inline unsigned long long fmix64(unsigned long long h){
+    h ^= h >> 33; h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33; h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+/* hash a word, FNV-1a followed by the murmur3 finalizer */
+inline unsigned long long hash_word(const char *word){
+    unsigned long long h = 0xCBF29CE484222325ULL;
+    for (const unsigned char *c=(const unsigned char*)word; *c; c++){
+        h ^= *c;
+        h *= 0x100000001B3ULL;
+    }
+    return fmix64(h);
+}
+
+/* map every context word to one of the hash_cxt columns, from the word itself
+ * so that columns do not depend on the vocabulary */
+void hash_contexts(){
+    int *hashed = (int*) malloc(sizeof(int)*(vocab_size+1));
+    if (hash_sign) cxt_sign = (float*) malloc(sizeof(float)*(vocab_size+1));
+    int nused=0;
+    char *used = (char*) calloc(hash_cxt, sizeof(char));
+    for (int t=0; t<=vocab_size; t++){
+        int c = -1;
+        if (t<vocab_size) c = (predefined_context) ? cxt_map[t] : (((unsigned int)t-Cid_upper <= cxt_span) ? t-Cid_upper : -1);
+        hashed[t] = -1;
+        if (hash_sign) cxt_sign[t] = 0;
+        if (c<0) continue;
+        const unsigned long long h = hash_word(tokename[t]);
+        hashed[t] = (int)(h % hash_cxt);
+        if (hash_sign) cxt_sign[t] = (h >> 63) ? -1.0f : 1.0f;
+        if (!used[hashed[t]]){ used[hashed[t]]=1; nused++; }
+    }
+    if (predefined_context){
+        free(cxt_map);
+        free(cxt_inv);
+    }
+    cxt_map = hashed;
+    free(used);
+    if (verbose) fprintf(stderr, "hashed context columns (%s)               = %d, %d used\n", (hash_sign) ? "signed  " : "unsigned", hash_cxt, nused);
+}
+
 /* load vocabulary */
 int get_vocab(){
     char token[MAX_TOKEN];
-    int freq;
+    unsigned long long freq;
     int i=0;
     // open vocabulary file
     FILE *fp = fopen(c_vocab_file_name, "r");
     // get statistics on vocabulary
-    while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
-        if (freq>=min_freq) Wid++;
+    while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
+        if (freq>=(unsigned long long)min_freq) Wid++;
         vocab_size++;
         ntoken+=freq;
     }
 
     if (verbose){ // print out some statistics
         fprintf(stderr, "number of unique tokens                       = %d\n",vocab_size);
-        fprintf(stderr, "total number of tokens in file                = %ld\n",ntoken);
+        fprintf(stderr, "total number of tokens in file                = %lld\n",ntoken);
         fprintf(stderr, "number of tokens to keep (>=%4d)             = %d\n",min_freq, Wid);
     }
 
@@ -165,17 +383,38 @@ int get_vocab(){
 
     // memory allocation
     tokename = (char**) malloc(sizeof(char*)*vocab_size);
-    tokenfound = (int*) malloc(sizeof(int)*vocab_size);
-    for (int i=0; i<vocab_size; i++) tokenfound[i]=false;
+    // probability of keeping each token, as in word2vec
+    if (sample>0){
+        sample_keep = (unsigned int*)malloc(sizeof(unsigned int)*(vocab_size+1));
+        sample_keep[vocab_size] = UINT_MAX; // unknown tokens
+    }
+    double nkept = 0;
     // fill up vocabulary hashtable and tokennames
-    while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
+    while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
+        if (sample>0){
+            const double threshold = sample*ntoken;
+            const double keep = (freq>0) ? (sqrt(freq/threshold)+1)*threshold/freq : 1.0;
+            sample_keep[i] = (keep>=1.0) ? UINT_MAX : (unsigned int)(keep*4294967296.0);
+            nkept += (keep>=1.0) ? freq : keep*freq;
+        }
         hash[token]=i;
         tokename[i] = (char*)malloc(strlen(token)+1);
         strcpy(tokename[i], token);
         i++;
     }
 
+    if (verbose && sample>0){
+        fprintf(stderr, "tokens kept after subsampling (%.1e)       = %.1f%%\n", sample, 100.0*nkept/ntoken);
+    }
+
+    // ids are only stable across runs with the very same vocabulary
+    vocab_crc = file_crc32(c_vocab_file_name);
+
     if ( predefined_context ){
+        cxt_crc = file_crc32(c_context_file_name);
+        // dense remapping, the last entry stands for unknown tokens
+        cxt_map = (int*) malloc(sizeof(int)*(vocab_size+1));
+        for (int i=0; i<=vocab_size; i++) cxt_map[i]=-1;
         // open context vocabulary file
         FILE *fc = fopen(c_context_file_name, "r");
         // get the number of context words in the given vocabulary
@@ -184,48 +423,99 @@ int get_vocab(){
             if ( hash.find(token) == hash.end() ){
                 throw std::runtime_error("unknow word from the context vocabulary: " + std::string(token));
             }
-            context[hash[token]]=i++;
+            cxt_map[hash[token]]=i++;
         }
-        if (verbose) fprintf(stderr, "context vocabulary size                       = %d\n", context.size());
+        // inverse mapping, to mirror symmetric records
+        cxt_inv = (int*) malloc(sizeof(int)*(i+1));
+        for (int t=0; t<vocab_size; t++) if (cxt_map[t]>=0) cxt_inv[cxt_map[t]]=t;
+        fclose(fc);
+        num_contexts = i;
+        if (verbose) fprintf(stderr, "context vocabulary size                       = %d\n", i);
     }else{
         // get back at the beginning of the file
         fseek(fp, 0, SEEK_SET);
         float appearance_freq;
         const float ratio = 1.0/ntoken;
         // insert statistics on vocabulary
-        while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
+        while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
             appearance_freq=freq*ratio;
             if (appearance_freq>upper_bound) Cid_upper++;
             if (appearance_freq>=lower_bound) Cid_lower++;
             // check whether other tokens need to be stored in hash table
-            if (freq<min_freq && appearance_freq<lower_bound) break;
+            if (freq<(unsigned long long)min_freq && appearance_freq<lower_bound) break;
         }
         if (verbose) fprintf(stderr, "context vocabulary size [%.3e,%.3e] = %d\n",upper_bound, lower_bound, Cid_lower-Cid_upper);
+        // context columns are token ids within [Cid_upper,Cid_lower]
+        cxt_span = ((Cid_lower<vocab_size) ? Cid_lower : vocab_size-1) - Cid_upper;
+        num_contexts = cxt_span+1;
     }
     fclose(fp);
 
+    if ( predefined_target ){
+        target_crc = file_crc32(c_target_file_name);
+        // rows are numbered in the order of the target file, the last entry stands for unknown tokens
+        target_map = (int*) malloc(sizeof(int)*(vocab_size+1));
+        target_inv = (int*) malloc(sizeof(int)*vocab_size);
+        for (int i=0; i<=vocab_size; i++) target_map[i]=-1;
+        FILE *ft = fopen(c_target_file_name, "r");
+        while(fscanf(ft, "%s\n", token) != EOF){
+            vocab_ids::const_iterator it = hash.find(token);
+            if ( it == hash.end() ){ // never seen in the corpus, nothing to count
+                fprintf(stderr, "WARNING: unknown word from the target vocabulary: %s, skipped\n", token);
+                continue;
+            }
+            if ( target_map[it->second]>=0 ) continue; // duplicate
+            target_inv[num_targets] = it->second;
+            target_map[it->second] = num_targets++;
+        }
+        fclose(ft);
+        if ( num_targets==0 ){
+            throw std::runtime_error("no known word in the target vocabulary " + std::string(c_target_file_name) + " !!");
+        }
+        if (verbose) fprintf(stderr, "target vocabulary size                        = %d\n", num_targets);
+    }
+
+    if (hash_cxt) hash_contexts();
+
     return 0;
 }
 
 /* write out cooccurrence vocabularies */
-void write_vocab(){
-    char * c_output_word_name = get_full_path(c_output_dir_name, "target_words.txt");
-    if (verbose){
-        fprintf(stderr, "writing target words vocabulary in %s\n", c_output_word_name);
-    }
-    // opening files
-    FILE *fw = fopen(c_output_word_name, "w");
-    for (int i=0; i<vocab_size; i++){
-        if (tokenfound[i]){
-            fprintf(fw, "%s\n", tokename[i]);
+void write_vocab(const window_t *win){
+    const char *c_output_dir_name = win->output_dir_name;
+    // target words of partial counts are only known once merged
+    if (!partial){
+        char * c_output_word_name = get_full_path(c_output_dir_name, "target_words.txt");
+        if (verbose){
+            fprintf(stderr, "writing target words vocabulary in %s\n", c_output_word_name);
         }
+        // opening files
+        FILE *fw = fopen(c_output_word_name, "w");
+        for (int i=0; i<vocab_size; i++){
+            if (win->tokenfound[i]){
+                fprintf(fw, "%s\n", tokename[(predefined_target) ? target_inv[i] : i]);
+            }
+        }
+        //closing files
+        fclose(fw);
+        // release memory
+        free(c_output_word_name);
     }
-    //closing files
-    fclose(fw);
-    // release memory
-    free(c_output_word_name);
 
-    if (!predefined_context){
+    if (hash_cxt){ // every context word with its column
+      char * c_output_context_name = get_full_path(c_output_dir_name, "context_words.txt");
+      if (verbose){
+        fprintf(stderr, "writing hashed context words vocabulary in %s\n", c_output_context_name);
+      }
+      FILE *fc = fopen(c_output_context_name, "w");
+      for (int i=0; i<vocab_size; i++){
+          if (cxt_map[i]<0) continue;
+          if (hash_sign) fprintf(fc, "%s %d %+d\n", tokename[i], cxt_map[i], (int)cxt_sign[i]);
+          else fprintf(fc, "%s %d\n", tokename[i], cxt_map[i]);
+      }
+      fclose(fc);
+      free(c_output_context_name);
+    }else if (!predefined_context){
       char * c_output_context_name = get_full_path(c_output_dir_name, "context_words.txt");
       if (verbose){
         fprintf(stderr, "writing context words vocabulary in %s\n", c_output_context_name);
@@ -244,54 +534,302 @@ void write_vocab(){
     }
 }
 
-/* add context */
-unsigned long long addcontext(cooccur_t *data, unsigned long long itr, const int target, const int context, const float weight){
-    data[itr].idx1=target;
-    data[itr].idx2=context; // keep indices starting from 0
-    (dyn_cxt) ? data[itr].val=weight : data[itr].val=1.0;
-    itr++;
+/* get token id from vocabulary, vocab_size for unknown tokens */
+inline unsigned int lookup(const char *word){
+    vocab_ids::const_iterator it = hash.find(word);
+    return (it == hash.end()) ? vocab_size : it->second;
+}
+
+/* get row of token t, -1 if t is not a target word */
+inline int target_row(const unsigned int t){
+    if (predefined_target) return target_map[t];
+    return (t<(unsigned int)Wid) ? (int)t : -1;
+}
+
+/* drop frequent tokens at random, the generator is seeded by the line position
+ * so that the very same tokens are dropped whatever the split of the corpus */
+inline int subsample(unsigned int *tokens, const int len, const long int line_position){
+    unsigned long long x = (unsigned long long)line_position + 0x9E3779B97F4A7C15ULL;
+    // splitmix64 seeding, then xorshift64*
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    x ^= (x >> 31);
+    if (x == 0) x = 1;
+    int n=0;
+    for (int j=0; j<len; j++){
+        x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+        const unsigned int r = (unsigned int)((x * 0x2545F4914F6CDD1DULL) >> 32);
+        tokens[n] = tokens[j];
+        n += (r < sample_keep[tokens[j]]) | (sample_keep[tokens[j]] == UINT_MAX);
+    }
+    return n;
+}
+
+/* kind of mapping from tokens to context columns */
+#define CXT_BOUNDS 0 // token ids within the bounds of the context vocabulary
+#define CXT_MAPPED 1 // cxt_map, predefined or hashed context vocabulary
+#define CXT_SIGNED 2 // cxt_map with the hashing sign in cxt_sign
+
+/* get context column of token t, -1 if t is not a context */
+template <int CXT>
+inline int context_column(const unsigned int t){
+    if (CXT != CXT_BOUNDS) return cxt_map[t];
+    // check whether this context is in our context vocabulary
+    return (t-Cid_upper <= cxt_span) ? (int)(t-Cid_upper) : -1; // keep indices starting from 0
+}
+
+/* get token id of context column c */
+inline unsigned int context_token(const unsigned int c){
+    return (predefined_context) ? (unsigned int)cxt_inv[c] : c+Cid_upper;
+}
+
+/* whether the record (t, c) stands for the pairs of target/context words t and c counted once */
+inline bool symmetric_record(const unsigned int t, const unsigned int c){
+    const int ct = (predefined_context) ? context_column<CXT_MAPPED>(t) : context_column<CXT_BOUNDS>(t);
+    return ct>=0 && context_token(c)<(unsigned int)Wid;
+}
+
+/* get the mirror (max id, context column of min id) of a symmetric record, 0 for other records */
+int mirror_record(const cooccur_t *record, cooccur_t *mirrored){
+    if (!symmetric_record(record->idx1, record->idx2)) return 0;
+    mirrored->idx1 = context_token(record->idx2);
+    mirrored->idx2 = (predefined_context) ? context_column<CXT_MAPPED>(record->idx1) : context_column<CXT_BOUNDS>(record->idx1);
+    mirrored->val = record->val;
+    return 1;
+}
+
+/* get context from a window of words
+ * DYN: weighting by distance, CXT: mapping of tokens to context columns,
+ * SYM: pairs of target/context words recorded once by their left word,
+ *      as (min id, context column of max id), see mirror_record()
+ * W: window size known at compile time (0 to use the window size)
+ */
+template <bool DYN, int CXT, bool SYM, int W>
+unsigned long long getcontext(cooccur_t *data, unsigned long long itr, const unsigned int* tokens, const int j, const int len, const window_t *win){
+    const int w = (W>0) ? W : win->cxt_size;
+    const float *weights = win->weights;
+    const int left = (j-w)>0 ? j-w : 0;
+    const int right = (j+w+1)<len ? j+w+1 : len;
+    const unsigned int target = tokens[j];
+    // the target is also a context, pairs with other targets are symmetric
+    const bool sym = SYM && context_column<CXT>(target)>=0;
+
+    // records are always written, the iterator only moves forward for actual contexts
+    for (int k=left; k<j; k++){
+        const int c = context_column<CXT>(tokens[k]);
+        data[itr].idx1=target;
+        data[itr].idx2=c;
+        data[itr].val=(DYN) ? weights[j-k] : 1.0f;
+        if (CXT == CXT_SIGNED) data[itr].val *= cxt_sign[tokens[k]];
+        itr += (c>=0) & !(sym && tokens[k]<(unsigned int)Wid); // already recorded by the left word
+    }
+    for (int k=j+1; k<right; k++){
+        const unsigned int t = tokens[k];
+        const int c = context_column<CXT>(t);
+        const bool swap = sym && t<(unsigned int)Wid && t<target; // recorded with the lowest id first
+        data[itr].idx1 = (swap) ? t : target;
+        data[itr].idx2 = (swap) ? context_column<CXT>(target) : c;
+        data[itr].val=(DYN) ? weights[k-j] : 1.0f;
+        if (CXT == CXT_SIGNED) data[itr].val *= cxt_sign[t];
+        itr += (c>=0);
+    }
     return itr;
 }
 
-/* get context from a window of words */
-unsigned long long getcontext(cooccur_t *data, unsigned long long itr, const int* tokens, const int j, const int len){
+/* select kernel specialized for the window size */
+template <bool DYN, int CXT, bool SYM>
+getcontext_t select_window(const int size){
+    switch (size){
+        case 2: return getcontext<DYN, CXT, SYM, 2>;
+        case 5: return getcontext<DYN, CXT, SYM, 5>;
+        case 10: return getcontext<DYN, CXT, SYM, 10>;
+        default: return getcontext<DYN, CXT, SYM, 0>;
+    }
+}
 
-    sparse_hash_map<unsigned int,unsigned int>::iterator cxt_itr;
-    int rightcxt = (j-cxt_size)>0 ? j-cxt_size : 0;
-    int leftcxt = (j+cxt_size+1)<len ? j+cxt_size+1 : len;
-    const int target = tokens[j];
-    if (target==-1){ // should not happen
-        throw std::runtime_error("unknown token!!");
+/* select kernel specialized for the context vocabulary and the counting mode */
+template <bool DYN>
+getcontext_t select_mode(const int size){
+    if (hash_cxt){ // hashed columns cannot be mirrored
+        return (hash_sign) ? select_window<DYN, CXT_SIGNED, false>(size) : select_window<DYN, CXT_MAPPED, false>(size);
+    }else if (predefined_context){
+        return (symmetric) ? select_window<DYN, CXT_MAPPED, true>(size) : select_window<DYN, CXT_MAPPED, false>(size);
+    }else{
+        return (symmetric) ? select_window<DYN, CXT_BOUNDS, true>(size) : select_window<DYN, CXT_BOUNDS, false>(size);
     }
+}
 
-    // set dynamic context variables
-    float weight, weight_itr;
-    if (dyn_cxt){
-        weight = (float)(cxt_size-(j-rightcxt)+1)/cxt_size;
-        weight_itr = 1.0/cxt_size;
+/* select kernel specialized for the window options */
+getcontext_t select_kernel(const window_t *win){
+    return (win->dyn_cxt) ? select_mode<true>(win->cxt_size) : select_mode<false>(win->cxt_size);
+}
+
+
+/* spill job handed over to a background thread */
+struct spill_job {
+    cooccur_t *data;
+    unsigned long long length;
+    int integer;
+    char file_name[MAX_FULLPATH_NAME];
+    pthread_t thread;
+    int running;
+    // checkpoint reached once the run is on disk
+    int window;
+    int tid;
+    int k;
+    long int position;
+    int j;
+};
+
+/* append a line to the manifest */
+void write_manifest(const char *format, ...){
+    if (manifest == NULL) return;
+    va_list args;
+    va_start(args, format);
+    pthread_mutex_lock(&manifest_lock);
+    vfprintf(manifest, format, args);
+    fflush(manifest);
+    pthread_mutex_unlock(&manifest_lock);
+    va_end(args);
+}
+
+/* sort a full buffer and write it on disk as a new spill run */
+void *spill( void *p ){
+    spill_job *job = (spill_job*)p;
+#ifdef __linux
+    // do not compete with the counting thread for its CPU
+    if (job->running){
+        cpu_set_t mask;
+        CPU_ZERO( &mask );
+        const int NUM_PROCS = sysconf(_SC_NPROCESSORS_CONF);
+        for (int c=0; c<NUM_PROCS; c++) CPU_SET( c, &mask );
+        sched_setaffinity( 0, sizeof(mask), &mask );
     }
-    for (int k=rightcxt; k<leftcxt; k++){
-        if (k!=j){
-            const int t=tokens[k];
-            if (predefined_context){
-                cxt_itr = context.find(t); // check whether this context is in our predefined context vocabulary
-                if (cxt_itr != context.end()){
-                    itr = addcontext(data, itr, target, cxt_itr->second, weight);
-                }
-            }else{
-                // check whether this context is in our context vocabulary
-                if (t>=Cid_upper && t<=Cid_lower){
-                    itr = addcontext(data, itr, target, t-Cid_upper, weight); // keep indices starting from 0
-                }
-            }
-        }
-        if (dyn_cxt)
-            (k<j)? weight+=weight_itr : weight-=weight_itr;
+#endif
+    std::sort(job->data, job->data+job->length, less_cooccur); // in place, memory is accounted
+    spill_writer_t *ftmp = spill_open_writer(job->file_name, job->integer, compress_tmp);
+    spill_write(ftmp, job->data, job->length);
+    spill_close_writer(ftmp);
+    // this run can now be reused when resuming
+    write_manifest("RUN %d %d %d %ld %d\n", job->window, job->tid, job->k, job->position, job->j);
+    return 0;
+}
+
+/* wait for the running spill job, if any */
+void wait_spill( spill_job *job ){
+    if (job->running){
+        if (pthread_join(job->thread, NULL) != 0) perror("Pthread_join failed");
+        job->running = false;
     }
+}
 
-    return itr;
+/**
+ * accumulation state of a thread for one window configuration:
+ * one buffer is filled while the other one is sorted and written by a spill job
+ **/
+struct accumulator {
+    cooccur_t *buffers[2];
+    unsigned long long capacity[2];
+    int current;
+    cooccur_t *data;
+    unsigned long long data_itr;
+    unsigned long long data_overflow;
+    int ftmp_itr;
+    long int resume_pos;
+    int resume_j;
+    spill_job job;
+};
+typedef accumulator accumulator_t;
+
+/* (re)allocate a buffer and account for it */
+void allocate_buffer( accumulator_t *acc, const int b, const unsigned long long capacity ){
+    if (acc->buffers[b]) free(acc->buffers[b]);
+    acc->buffers[b] = (cooccur_t*)malloc(sizeof(cooccur_t)*capacity);
+    if (acc->buffers[b] == NULL){
+        throw std::runtime_error("cannot allocate cooccurrence buffer, try a lower -memory value !!");
+    }
+    pthread_mutex_lock(&memory_lock);
+    buffer_memory += sizeof(cooccur_t)*capacity;
+    buffer_memory -= sizeof(cooccur_t)*acc->capacity[b];
+    if (buffer_memory > peak_buffer_memory) peak_buffer_memory = buffer_memory;
+    pthread_mutex_unlock(&memory_lock);
+    acc->capacity[b] = capacity;
+}
+
+/* release a buffer */
+void release_buffer( accumulator_t *acc, const int b ){
+    if (acc->buffers[b] == NULL) return;
+    free(acc->buffers[b]);
+    acc->buffers[b] = NULL;
+    pthread_mutex_lock(&memory_lock);
+    buffer_memory -= sizeof(cooccur_t)*acc->capacity[b];
+    pthread_mutex_unlock(&memory_lock);
+    acc->capacity[b] = 0;
 }
 
+/* resize the buffer to be filled next, according to the memory actually used by the process:
+ * buffers shrink by half above 90% of the limit and grow with the remaining headroom below */
+void adapt_buffer( accumulator_t *acc, const window_t *win, const int b ){
+    const unsigned long long rss = get_process_memory();
+    pthread_mutex_lock(&memory_lock);
+    if (rss > peak_process_memory) peak_process_memory = rss;
+    // allocated buffers are not resident until they are filled
+    const unsigned long long allocated = base_memory + buffer_memory;
+    pthread_mutex_unlock(&memory_lock);
+    const unsigned long long used = (rss > allocated) ? rss : allocated;
+    const long long headroom = (long long)(0.9*memory_ceiling) - (long long)used;
+    unsigned long long capacity = acc->capacity[b];
+    if (headroom < 0){
+        capacity /= 2;
+    }else{
+        // every buffer of every thread may grow at the same time
+        const unsigned long long grow = headroom / (2*num_threads*num_windows*sizeof(cooccur_t));
+        capacity += (grow < capacity/2) ? grow : capacity/2;
+    }
+    if (capacity < win->min_buffer_size) capacity = win->min_buffer_size;
+    if (capacity > win->max_buffer_size) capacity = win->max_buffer_size;
+    // only resize for significant changes
+    if (capacity < acc->capacity[b]*0.9 || capacity > acc->capacity[b]*1.1) allocate_buffer(acc, b, capacity);
+}
+
+/* hand over the current buffer to a spill job,
+ * the buffer holds every record before token j of the line at position */
+void flush_accumulator( accumulator_t *acc, const window_t *win, const int background, const long int position, const int j ){
+    wait_spill(&acc->job); // the other buffer must be released
+    acc->job.data = acc->data;
+    acc->job.length = acc->data_itr;
+    acc->job.integer = integer_counts(win);
+    acc->job.k = acc->ftmp_itr;
+    acc->job.position = position;
+    acc->job.j = j;
+    run_file_name(acc->job.file_name, win, acc->job.tid, acc->ftmp_itr++);
+    if (background){
+        acc->job.running = true;
+        if (pthread_create(&acc->job.thread, NULL, spill, &acc->job) != 0){
+            perror("Pthread_create failed");
+            acc->job.running = false;
+            spill(&acc->job); // fallback on synchronous spill
+        }
+    }else spill(&acc->job);
+    acc->current = 1-acc->current;
+    if (background) adapt_buffer(acc, win, acc->current); // this buffer has been released
+    acc->data = acc->buffers[acc->current];
+    acc->data_overflow = acc->capacity[acc->current]-(win->cxt_size*2);
+    acc->data_itr=0;
+}
+
+/* sort the last buffer and keep it in memory as a run, to be merged without
+ * touching the disk, it remains accounted until released by the merge */
+void keep_accumulator( accumulator_t *acc, window_t *win, const int tid ){
+    wait_spill(&acc->job);
+    std::sort(acc->data, acc->data+acc->data_itr, less_cooccur);
+    win->mem_runs[tid] = acc->data;
+    win->mem_length[tid] = acc->data_itr;
+    win->mem_capacity[tid] = acc->capacity[acc->current];
+    acc->buffers[acc->current] = NULL;
+    acc->capacity[acc->current] = 0;
+    acc->data = NULL;
+}
 
 /**
  * the worker
@@ -301,65 +839,76 @@ void *cooccurrence( void *p ){
     Thread* thread = (Thread*)p;
     const long int start = thread->start();
     const long int end = thread->end();
-    const long int nbop = (end-start)/100;
-    // get output file name
-    char output_file_name[MAX_FULLPATH_NAME];
+    const long int nbop = (((end==FILE_END) ? File(std::string(c_input_file_name)).size() : end)-start)/100;
+    const int tid = (thread->id() != -1) ? thread->id() : 0;
 
     // attach thread to CPU
     if (thread->id() != -1){
         thread->set();
-        sprintf(output_file_name, "%s-%ld", c_output_file_name, thread->id());
         if (verbose) fprintf(stderr, "create pthread n°%ld, reading from position %ld to %ld\n",thread->id(), start, end-1);
-    }else{
-        sprintf(output_file_name, "%s-%d", c_output_file_name, 0);
     }
 
-    // create output file
-    int ftmp_itr=0;
-    char tmp_output_file_name[MAX_FULLPATH_NAME];
-    sprintf(tmp_output_file_name,"%s_%04d.bin",output_file_name, ftmp_itr);
-    if (verbose)  fprintf(stderr, "write in temporary files: %s_####.bin\n",output_file_name);
-    FILE *ftmp = fopen(tmp_output_file_name, "wb");
+    // create accumulators
+    accumulator_t *acc = (accumulator_t*)calloc(num_windows, sizeof(accumulator_t));
+    long int resume_from = end;
+    for (int w=0; w<num_windows; w++){
+        // skip what has already been saved by an interrupted run
+        acc[w].ftmp_itr = windows[w].nfile[tid];
+        acc[w].resume_pos = windows[w].resume_pos[tid];
+        acc[w].resume_j = windows[w].resume_j[tid];
+        acc[w].job.window = w;
+        acc[w].job.tid = tid;
+        if (acc[w].resume_pos < resume_from) resume_from = (acc[w].resume_pos > start) ? acc[w].resume_pos : start;
+        if (acc[w].resume_pos >= end) continue; // nothing left to count
 
-    // create struct to store cooccurrence
-    cooccur_t * data = (cooccur_t*)malloc(sizeof(cooccur_t)*max_cooccur_size);
-    unsigned long long data_itr=0;
-    const unsigned long long data_overflow = max_cooccur_size-(cxt_size*2);
+        if (verbose){
+            for (int d=0; d<num_tmp_dirs; d++) fprintf(stderr, "write in temporary files: %s-%d_####.bin\n",windows[w].tmp_file_names[d], tid);
+        }
+        const unsigned long long buffer_size = windows[w].max_cooccur_size/2;
+        allocate_buffer(&acc[w], 0, buffer_size);
+        allocate_buffer(&acc[w], 1, buffer_size);
+        acc[w].data = acc[w].buffers[0];
+        acc[w].data_overflow = buffer_size-(windows[w].cxt_size*2);
+    }
 
     // open input file
     std::string input_file_name = std::string(c_input_file_name);
     File input_file(input_file_name);
     input_file.open();
-    input_file.jump_to_position(start);
+    input_file.jump_to_position(resume_from);
 
     int k, itr=0;
     int line_size = MAX_TOKEN_PER_LINE;
-    int *tokens = (int*)malloc(line_size*sizeof(int));
+    unsigned int *tokens = (unsigned int*)malloc(line_size*sizeof(unsigned int));
     char word[MAX_TOKEN];
     long int position=input_file.position();
     if (verbose) loadbar(thread->id(), itr, 100);
     // read and store tokens
-    while (position<end){
+    while (position<end && !input_file.eof()){
+        const long int line_position = position;
         k=0;
         // get next word
         while (input_file.getword(word)){
-            tokens[k++] = hash[word];
+            tokens[k++] = lookup(word);
             if(k>=line_size) {
                 line_size *= 2;
-                tokens = (int*)realloc(tokens, sizeof(int) * line_size);
+                tokens = (unsigned int*)realloc(tokens, sizeof(unsigned int) * line_size);
             }
         }
+        if (sample_keep) k = subsample(tokens, k, line_position);
         // store token with context
         for (int j=0; j<k; j++){
-            if (tokens[j]>=0 && tokens[j]<Wid){
-                data_itr = getcontext( data, data_itr, tokens, j, k);
-                if (data_itr>data_overflow){ // save date on disk
-                    qsort(data, data_itr, sizeof(cooccur_t), compare);
-                    write(data,data_itr,ftmp);
-                    fclose(ftmp);
-                    sprintf(tmp_output_file_name,"%s_%04d.bin",output_file_name, ++ftmp_itr);
-                    ftmp = fopen(tmp_output_file_name,"wb");
-                    data_itr=0;
+            const int row = target_row(tokens[j]);
+            if (row>=0){
+                for (int w=0; w<num_windows; w++){
+                    if (line_position < acc[w].resume_pos || (line_position == acc[w].resume_pos && j < acc[w].resume_j)) continue;
+                    const unsigned long long from = acc[w].data_itr;
+                    acc[w].data_itr = windows[w].kernel( acc[w].data, acc[w].data_itr, tokens, j, k, &windows[w]);
+                    // predefined targets are stored as dense rows
+                    if (predefined_target) for (unsigned long long r=from; r<acc[w].data_itr; r++) acc[w].data[r].idx1 = row;
+                    if (acc[w].data_itr>acc[w].data_overflow){ // save data on disk in background
+                        flush_accumulator(&acc[w], &windows[w], true, line_position, j+1);
+                    }
                 }
             }
         }
@@ -371,29 +920,483 @@ void *cooccurrence( void *p ){
         }
     }
     if (verbose) loadbar(thread->id(), 100, 100);
-    qsort(data, data_itr, sizeof(cooccur_t), compare);
-    write(data,data_itr,ftmp);
-    fclose(ftmp);
+    for (int w=0; w<num_windows; w++){
+        if (acc[w].resume_pos < end) keep_accumulator(&acc[w], &windows[w], tid);
+        windows[w].nfile[tid]=acc[w].ftmp_itr;
+    }
 
     // closing input file
     input_file.close();
 
     // free memory
-    free(data);
+    for (int w=0; w<num_windows; w++){
+        release_buffer(&acc[w], 0);
+        release_buffer(&acc[w], 1);
+    }
+    free(acc);
     free(tokens);
 
     // exit thread
     if ( thread->id()!= -1 ){
-        nfile[thread->id()]=ftmp_itr+1;
         // existing pthread
         pthread_exit( (void*)thread->id() );
+    }
+
+    return 0;
+}
+
+
+/* number of hash functions of the count-min sketch */
+#define SKETCH_DEPTH 4
+/* value of a sketch counter which cannot count any further */
+#define SKETCH_SATURATED 0xFFFFFFFFu
+
+/* number of rows of the cooccurrence matrix */
+inline int num_rows(){
+    return (predefined_target) ? num_targets : Wid;
+}
+
+/* key of a pair, keys are sorted as records */
+inline unsigned long long pair_key(const cooccur_t *cr){
+    return ((unsigned long long)cr->idx1 << 32) | cr->idx2;
+}
+
+/* counter of a pair in the d-th row of the sketch, by double hashing */
+inline unsigned long long sketch_slot(const window_t *win, const unsigned long long h, const int d){
+    return d*win->sketch_width + (h + d*((h >> 32) | 1)) % win->sketch_width;
+}
+
+/* add a value to a counter shared by every thread, a full counter stays saturated */
+inline void atomic_add(unsigned int *counter, const unsigned int val){
+    unsigned int expected = __atomic_load_n(counter, __ATOMIC_RELAXED), desired;
+    do{
+        desired = (expected > SKETCH_SATURATED - val) ? SKETCH_SATURATED : expected + val;
+    }while (!__atomic_compare_exchange_n(counter, &expected, desired, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+/* add a record to the sketch, weights of dynamic contexts are multiples of 1/cxt_size
+ * and integer counts are exact, so that the scaled value is an exact integer */
+inline void sketch_add(window_t *win, const cooccur_t *cr){
+    const unsigned long long h = fmix64(pair_key(cr));
+    const unsigned int val = (unsigned int)lrintf(cr->val * win->sketch_scale);
+    for (int d=0; d<SKETCH_DEPTH; d++) atomic_add(&win->sketch[sketch_slot(win, h, d)], val);
+}
+
+/* get the sketched count of a pair, never lower than its actual count, infinite once saturated */
+inline float sketch_estimate(const window_t *win, const cooccur_t *cr){
+    const unsigned long long h = fmix64(pair_key(cr));
+    unsigned int estimate = win->sketch[sketch_slot(win, h, 0)];
+    for (int d=1; d<SKETCH_DEPTH; d++) estimate = std::min(estimate, win->sketch[sketch_slot(win, h, d)]);
+    return (estimate == SKETCH_SATURATED) ? HUGE_VALF : (float)estimate / win->sketch_scale;
+}
+
+/* memory taken by the sketch of a window and its row sums */
+inline unsigned long long sketch_memory(const window_t *win){
+    return SKETCH_DEPTH*win->sketch_width*sizeof(unsigned int) + num_rows()*sizeof(double);
+}
+
+/* sorted records of the pairs counted exactly by a thread */
+cooccur_t *sorted_pairs(const pair_map &pairs){
+    std::vector< std::pair<unsigned long long, float> > entries(pairs.begin(), pairs.end());
+    std::sort(entries.begin(), entries.end());
+    cooccur_t *records = (cooccur_t*)malloc(sizeof(cooccur_t)*entries.size());
+    for (size_t e=0; e<entries.size(); e++){
+        records[e].idx1 = (unsigned int)(entries[e].first >> 32);
+        records[e].idx2 = (unsigned int)entries[e].first;
+        records[e].val = entries[e].second;
+    }
+    return records;
+}
+
+/* write the pairs counted exactly by a thread as its next sorted run, once they exceed its share of memory */
+void spill_pairs(pair_map &pairs, window_t *win, const int tid){
+    char c_run_file_name[MAX_FULLPATH_NAME];
+    cooccur_t *records = sorted_pairs(pairs);
+    const unsigned long long n = pairs.size();
+    pair_map().swap(pairs);
+    run_file_name(c_run_file_name, win, tid, win->nfile[tid]++);
+    spill_writer_t *sw = spill_open_writer(c_run_file_name, integer_counts(win), compress_tmp);
+    spill_write(sw, records, n);
+    spill_close_writer(sw);
+    free(records);
+}
+
+/* keep the last pairs counted exactly by a thread in memory, as a sorted run */
+void keep_pairs(pair_map &pairs, window_t *win, const int tid){
+    if (pairs.empty()) return;
+    win->mem_runs[tid] = sorted_pairs(pairs);
+    win->mem_length[tid] = win->mem_capacity[tid] = pairs.size();
+    pair_map().swap(pairs);
+    pthread_mutex_lock(&memory_lock);
+    buffer_memory += sizeof(cooccur_t)*win->mem_capacity[tid];
+    if (buffer_memory > peak_buffer_memory) peak_buffer_memory = buffer_memory;
+    pthread_mutex_unlock(&memory_lock);
+}
+
+/**
+ * the worker of the sketch mode: the first pass adds every record to the sketches,
+ * the second one counts exactly the pairs whose sketched count reaches the threshold
+ **/
+void *sketch_count( void *p ){
+    // get start & end for this thread
+    Thread* thread = (Thread*)p;
+    const long int start = thread->start();
+    const long int end = thread->end();
+    const long int nbop = (((end==FILE_END) ? File(std::string(c_input_file_name)).size() : end)-start)/100;
+    const int tid = (thread->id() != -1) ? thread->id() : 0;
+
+    // attach thread to CPU
+    if (thread->id() != -1){
+        thread->set();
+        if (verbose) fprintf(stderr, "create pthread n°%ld, reading from position %ld to %ld (pass %d)\n",thread->id(), start, end-1, sketch_pass);
+    }
+
+    // records of one target word, sums and counts of this thread
+    cooccur_t *data = (cooccur_t*)malloc(sizeof(cooccur_t)*(2*MAX_CXT_SIZE+1));
+    std::vector<double*> row_sums(num_windows, (double*)NULL);
+    std::vector<double> total(num_windows, 0);
+    std::vector<pair_map> heavy(num_windows);
+    if (sketch_pass == 1) for (int w=0; w<num_windows; w++) row_sums[w] = (double*)calloc(num_rows(), sizeof(double));
+
+    // open input file
+    std::string input_file_name = std::string(c_input_file_name);
+    File input_file(input_file_name);
+    input_file.open();
+    input_file.jump_to_position(start);
+
+    int k, itr=0;
+    int line_size = MAX_TOKEN_PER_LINE;
+    unsigned int *tokens = (unsigned int*)malloc(line_size*sizeof(unsigned int));
+    char word[MAX_TOKEN];
+    long int position=input_file.position();
+    if (verbose) loadbar(thread->id(), itr, 100);
+    while (position<end && !input_file.eof()){
+        const long int line_position = position;
+        k=0;
+        // get next word
+        while (input_file.getword(word)){
+            tokens[k++] = lookup(word);
+            if(k>=line_size) {
+                line_size *= 2;
+                tokens = (unsigned int*)realloc(tokens, sizeof(unsigned int) * line_size);
+            }
+        }
+        if (sample_keep) k = subsample(tokens, k, line_position);
+        for (int j=0; j<k; j++){
+            const int row = target_row(tokens[j]);
+            if (row<0) continue;
+            for (int w=0; w<num_windows; w++){
+                const unsigned long long n = windows[w].kernel( data, 0, tokens, j, k, &windows[w]);
+                for (unsigned long long r=0; r<n; r++){
+                    data[r].idx1 = row;
+                    if (sketch_pass == 1){
+                        sketch_add(&windows[w], &data[r]);
+                        row_sums[w][row] += data[r].val;
+                        total[w] += data[r].val;
+                    }else if (sketch_estimate(&windows[w], &data[r]) >= sketch_threshold){
+                        heavy[w][pair_key(&data[r])] += data[r].val;
+                        if (heavy[w].size() >= windows[w].heavy_limit) spill_pairs(heavy[w], &windows[w], tid);
+                    }
+                }
+            }
+        }
+        // get current position in stream
+        position = input_file.position();
+        if (verbose){
+            if ( position-(start+(itr*nbop)) > nbop)
+                loadbar(thread->id(), ++itr, 100);
+        }
+    }
+    if (verbose) loadbar(thread->id(), 100, 100);
+
+    // gather the sums of every thread, pairs counted exactly are merged from the runs of the threads
+    if (sketch_pass == 1){
+        pthread_mutex_lock(&sketch_lock);
+        for (int w=0; w<num_windows; w++){
+            for (int r=0; r<num_rows(); r++) windows[w].row_sums[r] += row_sums[w][r];
+            windows[w].sketch_total += total[w];
+            free(row_sums[w]);
+        }
+        pthread_mutex_unlock(&sketch_lock);
     }else{
-        nfile[0]=ftmp_itr+1;
+        for (int w=0; w<num_windows; w++) keep_pairs(heavy[w], &windows[w], tid);
+    }
+
+    // closing input file
+    input_file.close();
+    free(data);
+    free(tokens);
+
+    // exit thread
+    if ( thread->id()!= -1 ){
+        // existing pthread
+        pthread_exit( (void*)thread->id() );
     }
 
     return 0;
 }
 
+/* count in two passes over the corpus, sketches share the given amount of memory,
+ * and so do the pairs counted exactly by the threads before they are spilled */
+void sketch_windows(MultiThread &threads, const long int *boundaries, const unsigned long long memory){
+    int sum_cxt_size=0;
+    for (int w=0; w<num_windows; w++) sum_cxt_size += windows[w].cxt_size;
+    for (int w=0; w<num_windows; w++){
+        window_t *win = &windows[w];
+        win->sketch_width = memory / (SKETCH_DEPTH*sizeof(unsigned int)) * win->cxt_size / sum_cxt_size;
+        if (win->sketch_width < 1024) win->sketch_width = 1024;
+        win->sketch_scale = (integer_counts(win)) ? 1 : win->cxt_size;
+        win->sketch = (unsigned int*)calloc(SKETCH_DEPTH*win->sketch_width, sizeof(unsigned int));
+        if (win->sketch == NULL) throw std::runtime_error("cannot allocate sketch, try a lower -memory value !!");
+        win->row_sums = (double*)calloc(num_rows(), sizeof(double));
+        buffer_memory += sketch_memory(win);
+        if (buffer_memory > peak_buffer_memory) peak_buffer_memory = buffer_memory;
+        // a pair takes an entry of the map, then a record once sorted
+        win->heavy_limit = memory / num_threads / (sizeof(pair_map::value_type)+sizeof(cooccur_t)) * win->cxt_size / sum_cxt_size;
+        if (win->heavy_limit < 4096) win->heavy_limit = 4096;
+        if (verbose) fprintf(stderr, "count-min sketch of window cxt-size=%d, dyn-cxt=%d = %d x %llu counters\n", win->cxt_size, win->dyn_cxt, SKETCH_DEPTH, win->sketch_width);
+    }
+    sketch_pass = 1;
+    threads.linear( sketch_count, boundaries );
+    if (verbose) fprintf(stderr, "\n");
+    sketch_pass = 2;
+    threads.linear( sketch_count, boundaries );
+}
+
+/* write out the pairs counted exactly, merged from the runs of the threads, with the sum of every row */
+int write_sketched(window_t *win, const int nbthread){
+    char c_final_file_name[MAX_FULLPATH_NAME], c_index_file_name[MAX_FULLPATH_NAME];
+    sprintf(c_final_file_name,"%s.bin",win->output_file_name);
+    sprintf(c_index_file_name,"%s.idx",win->output_file_name);
+    const int num = count_runs(win, nbthread);
+    unsigned long long nbytes = 0;
+    spill_reader_t **fid = (spill_reader_t**)calloc(num, sizeof(spill_reader_t*));
+    open_runs(win, nbthread, fid, 0, &nbytes);
+    if (verbose) fprintf(stderr, "\nmerging %d runs of pairs counted exactly (%.1f MB on disk).\n", num, (float)nbytes/MEGAOCTET);
+    // next record of every run, the lowest pair first
+    typedef std::pair<unsigned long long, int> head_t;
+    std::priority_queue< head_t, std::vector<head_t>, std::greater<head_t> > heads;
+    std::vector<cooccur_t> next(num);
+    for (int i=0; i<num; i++) if (spill_read(fid[i], &next[i])) heads.push(head_t(pair_key(&next[i]), i));
+
+    // pairs below the threshold are dropped even if counted exactly,
+    // entries are written at once if they fit in the memory left
+    const long long headroom = (long long)(0.9*memory_ceiling) - (long long)(base_memory + buffer_memory);
+    csr_writer_t *fout = csr_open_writer(c_final_file_name, std::max(min_pair_count, sketch_threshold), top_k, (headroom>0) ? headroom : 0, num_columns());
+    std::vector<cooccur_t> row;
+    double error = 0;
+    unsigned long long counter = 0;
+    win->sketch_candidates = 0;
+    for (int r=0; r<num_rows(); r++){
+        if (win->row_sums[r] == 0) continue; // not found in the corpus
+        row.clear();
+        while (!heads.empty() && (heads.top().first >> 32) == (unsigned long long)r){
+            const int i = heads.top().second;
+            heads.pop();
+            // a pair spilled by several threads, or several times by one thread
+            if (!row.empty() && row.back().idx2 == next[i].idx2) row.back().val += next[i].val;
+            else row.push_back(next[i]);
+            if (spill_read(fid[i], &next[i])) heads.push(head_t(pair_key(&next[i]), i));
+        }
+        for (size_t e=0; e<row.size(); e++){
+            const float estimate = sketch_estimate(win, &row[e]);
+            if (estimate < HUGE_VALF) error += estimate - row[e].val; // saturated counters only say the pair is heavy
+        }
+        win->sketch_candidates += row.size();
+        csr_append_row(fout, r, win->row_sums[r], (row.empty()) ? NULL : &row[0], row.size());
+        win->tokenfound[r] = 1;
+        counter++;
+    }
+    if (counter == 0){
+        throw std::runtime_error("no cooccurrence found in the corpus!!");
+    }
+    win->sketch_mean_error = (win->sketch_candidates == 0) ? 0 : error/win->sketch_candidates;
+    const unsigned long long nnz = csr_close_writer(fout);
+    csr_write_index(c_final_file_name, c_index_file_name);
+    if (verbose){
+        fprintf(stderr,"%llu pairs counted exactly, %llu kept (>= %.2f), sketched counts overestimated by %.3f on average.\n", win->sketch_candidates, nnz, std::max(min_pair_count, sketch_threshold), win->sketch_mean_error);
+        fprintf(stderr,"done, all cooccurrences saved in file %s.\n", c_final_file_name);
+    }
+    // removing temporary files
+    for (int i=0; i<num; i++) spill_close_reader(fid[i]);
+    free(fid);
+    release_memory_runs(win, nbthread);
+    for (int f=0; f<nbthread; f++) remove_runs(win, f, 0);
+    buffer_memory -= sketch_memory(win);
+    free(win->sketch);
+    free(win->row_sums);
+    win->sketch = NULL;
+    win->row_sums = NULL;
+    return 0;
+}
+
+/* check that an existing output directory has been built with the same options */
+void check_options(window_t *win){
+    char *c_options_file_name = get_full_path(win->output_dir_name, "options.txt");
+    char c_bin_file_name[MAX_FULLPATH_NAME];
+    sprintf(c_bin_file_name, "%s.bin", win->output_file_name);
+    is_file(c_options_file_name);
+    is_file(c_bin_file_name);
+    std::map<std::string, std::string> options = read_options(c_options_file_name);
+    const std::string where = " does not match the previous run in " + std::string(win->output_dir_name) + " !!";
+    if ( options.find("VOCAB_CRC32") == options.end() ){
+        throw std::runtime_error("no vocabulary checksum in " + std::string(c_options_file_name) + ", cannot update cooccurrences !!");
+    }
+    if ( strtoul(options["VOCAB_CRC32"].c_str(), NULL, 10) != vocab_crc ){
+        throw std::runtime_error("-vocab-file" + where);
+    }
+    if ( atoi(options["VOCAB_MIN_COUNT"].c_str()) != min_freq ){
+        throw std::runtime_error("-min-freq" + where);
+    }
+    if ( predefined_context ){
+        if ( options["CXT_FILE"] == "none" || strtoul(options["CXT_CRC32"].c_str(), NULL, 10) != cxt_crc ){
+            throw std::runtime_error("-cxt-file" + where);
+        }
+    }else{
+        if ( options["CXT_FILE"] != "none" ){
+            throw std::runtime_error("-cxt-file" + where);
+        }
+        // bounds are written with a limited precision
+        if ( fabs(atof(options["CONTEXT_VOCAB_UPPER_BOUND_FREQ"].c_str())-upper_bound) > 1e-6
+          || fabs(atof(options["CONTEXT_VOCAB_LOWER_BOUND_FREQ"].c_str())-lower_bound) > 1e-6 ){
+            throw std::runtime_error("-upper-bound/-lower-bound" + where);
+        }
+    }
+    if ( predefined_target ){
+        if ( options["TARGET_FILE"] == "" || options["TARGET_FILE"] == "none" || strtoul(options["TARGET_CRC32"].c_str(), NULL, 10) != target_crc ){
+            throw std::runtime_error("-target-file" + where);
+        }
+    }else if ( options["TARGET_FILE"] != "" && options["TARGET_FILE"] != "none" ){
+        throw std::runtime_error("-target-file" + where);
+    }
+    if ( fabs(atof(options["SAMPLE"].c_str())-sample) > 1e-6*sample ){
+        throw std::runtime_error("-sample" + where);
+    }
+    if ( atoi(options["DYN_CXT"].c_str()) != win->dyn_cxt ){
+        throw std::runtime_error("-dyn-cxt" + where);
+    }
+    if ( atoi(options["HASH_CXT"].c_str()) != hash_cxt || atoi(options["HASH_SIGN"].c_str()) != hash_sign ){
+        throw std::runtime_error("-hash-cxt/-hash-sign" + where);
+    }
+    if ( atoi(options["WINDOW_SIZE"].c_str()) != win->cxt_size ){
+        throw std::runtime_error("-cxt-size" + where);
+    }
+    // dropped counts cannot be recovered
+    if ( atof(options["MIN_PAIR_COUNT"].c_str()) > 0 || atoi(options["TOP_K"].c_str()) > 0 ){
+        throw std::runtime_error("cooccurrences in " + std::string(win->output_dir_name) + " have been truncated, cannot update them !!");
+    }
+    // keep track of every corpus file counted so far
+    win->corpus_files = strdup((options["CORPUS_FILE"] + "," + c_input_file_name).c_str());
+    free(c_options_file_name);
+}
+
+/* remove the runs of a thread from the k-th one, e.g. left by an interrupted spill */
+void remove_runs(const window_t *win, const int tid, int k){
+    char c_run_file_name[MAX_FULLPATH_NAME];
+    for (;; k++){
+        run_file_name(c_run_file_name, win, tid, k);
+        if (remove(c_run_file_name) != 0) break;
+    }
+}
+
+/* options which must not change between an interrupted run and its resumption */
+std::string manifest_header(const long int fsize){
+    std::string header = "HPCA-MANIFEST 1\n";
+    header += "CORPUS " + typeToString(fsize) + " " + std::string(c_input_file_name) + "\n";
+    char line[MAX_FULLPATH_NAME];
+    sprintf(line, "OPTIONS %d %f %f %lu %lu %lu %d %d %d %d/%d %e %d %f %d %d %d %f\n", min_freq, upper_bound, lower_bound, vocab_crc, cxt_crc, target_crc, update, compress_tmp, partial, shard_id, num_shards, sample, symmetric, min_pair_count, top_k, hash_cxt, hash_sign, sketch_threshold);
+    header += line;
+    if (!tmp_dirs.empty()){ // runs are looked for in the same scratch directories
+        header += "TMP_DIRS";
+        for (int d=0; d<num_tmp_dirs; d++) header += " " + tmp_dirs[d];
+        header += "\n";
+    }
+    for (int w=0; w<num_windows; w++){
+        sprintf(line, "WINDOW %d %d %d\n", w, windows[w].cxt_size, windows[w].dyn_cxt);
+        header += line;
+    }
+    return header;
+}
+
+/* check the manifest of an interrupted run and get back its split of the corpus */
+std::vector<long int> read_manifest(const std::string &header){
+    std::ifstream ifs(c_manifest_file_name);
+    if ( ifs.fail() ){
+        throw std::runtime_error("no manifest found in " + std::string(c_output_dir_name) + ", cannot resume !!");
+    }
+    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    if ( content.compare(0, header.size(), header) != 0 ){
+        throw std::runtime_error("options or input files differ from the interrupted run, cannot resume !!");
+    }
+    std::istringstream iss(content.substr(header.size()));
+    std::string key;
+    int n=0;
+    iss >> key >> n;
+    if ( key != "SPLIT" || n <= 0 ){
+        throw std::runtime_error("corrupted manifest " + std::string(c_manifest_file_name) + " !!");
+    }
+    std::vector<long int> split(n+1);
+    for (int t=0; t<=n; t++) iss >> split[t];
+    return split;
+}
+
+/* get back the runs completed by an interrupted run */
+void resume_windows(){
+    std::ifstream ifs(c_manifest_file_name);
+    std::vector< std::vector< std::pair<long int, int> > > runs(num_windows*num_threads);
+    std::string line, key;
+    while ( getline(ifs, line) ){
+        std::istringstream iss(line);
+        iss >> key;
+        if ( key == "RUN" ){
+            int w, tid, k, j;
+            long int position;
+            if ( !(iss >> w >> tid >> k >> position >> j) ) break; // truncated line
+            if ( w<0 || w>=num_windows || tid<0 || tid>=num_threads || k<0 ) continue;
+            std::vector< std::pair<long int, int> > &r = runs[w*num_threads+tid];
+            if ( k >= (int)r.size() ) r.resize(k+1, std::make_pair(-1L, 0));
+            r[k] = std::make_pair(position, j);
+        }else if ( key == "MERGED" ){
+            int w;
+            if ( (iss >> w) && w>=0 && w<num_windows ) windows[w].merged = 1;
+        }else if ( key == "MERGING" ){
+            int w;
+            if ( (iss >> w) && w>=0 && w<num_windows ) windows[w].merging = 1;
+        }
+    }
+    char c_run_file_name[MAX_FULLPATH_NAME];
+    for (int w=0; w<num_windows; w++){
+        window_t *win = &windows[w];
+        for (int t=0; t<num_threads; t++){
+            if ( win->merged ){ // nothing left to do for this window
+                win->resume_pos[t] = LONG_MAX;
+                continue;
+            }
+            if ( win->merging ){ // nothing left to count, runs left on disk are only removed
+                win->resume_pos[t] = LONG_MAX;
+                win->nfile[t] = runs[w*num_threads+t].size();
+                continue;
+            }
+            // keep consecutive runs still on disk
+            const std::vector< std::pair<long int, int> > &r = runs[w*num_threads+t];
+            int k=0;
+            for (; k<(int)r.size() && r[k].first>=0; k++){
+                run_file_name(c_run_file_name, win, t, k);
+                if ( access(c_run_file_name, R_OK) != 0 ) break;
+                win->resume_pos[t] = r[k].first;
+                win->resume_j[t] = r[k].second;
+            }
+            win->nfile[t] = k;
+            remove_runs(win, t, k); // incomplete runs
+        }
+        if (verbose){
+            int nrun = 0;
+            for (int t=0; t<num_threads; t++) nrun += win->nfile[t];
+            fprintf(stderr, "resuming window cxt-size=%d, dyn-cxt=%d: %s\n", win->cxt_size, win->dyn_cxt,
+                    (win->merged || win->merging) ? "already merged" : (typeToString(nrun) + " runs reused").c_str());
+        }
+    }
+}
 
 /**
  * Run with multithreading
@@ -412,38 +1415,147 @@ int run(){
         fprintf(stderr, "number of byte in %s = %ld\n",c_input_file_name,fsize);
         fflush(stderr);
     }
+    // get the byte range of this shard, every node computes the same split
+    long int shard_start = 0, shard_end = fsize;
+    if (num_shards > 1){
+        input_file.split(num_shards);
+        shard_start = input_file.flines[shard_id];
+        shard_end = input_file.flines[shard_id+1];
+        if (verbose) fprintf(stderr, "counting shard %d/%d, from position %ld to %ld\n", shard_id, num_shards, shard_start, shard_end-1);
+    }
+
+    // an interrupted run must be resumed with the same split of the corpus
+    const std::string header = manifest_header(fsize);
+    std::vector<long int> split;
+    if (resume){
+        split = read_manifest(header);
+        num_threads = split.size()-1;
+    }
 
     // get optimal number of threads
-    MultiThread threads( num_threads, 1, true, fsize, NULL, NULL);
+    MultiThread threads( num_threads, 1, true, shard_end-shard_start, NULL, NULL);
+    if (resume && threads.nb_thread() != num_threads){
+        throw std::runtime_error("the interrupted run used " + typeToString(num_threads) + " threads, cannot resume with " + typeToString(threads.nb_thread()) + " !!");
+    }
     num_threads = threads.nb_thread();
     if (verbose) fprintf(stderr, "number of pthreads = %d\n", num_threads);
-    input_file.split(num_threads);
+    if (resume){
+        if (input_file.flines) free(input_file.flines);
+        input_file.flines = (long int*)malloc(sizeof(long int)*(num_threads+1));
+        for (int t=0; t<=num_threads; t++) input_file.flines[t] = split[t];
+    }else input_file.split(num_threads, shard_start, (num_shards > 1) ? shard_end : -1);
     // set max size for storing cooccurrence
     const float current_memory = (float)get_available_memory()/GIGAOCTET;
     if (memory_limit>current_memory) memory_limit = current_memory;
-    max_cooccur_size = (unsigned long long) (0.7 * memory_limit * GIGAOCTET/(sizeof(cooccur_t)) / num_threads);
-    // set number of file per thread
-    nfile = (int*)calloc(num_threads, sizeof(int));
+    const float cgroup_memory = (float)get_cgroup_memory_limit()/GIGAOCTET;
+    if (cgroup_memory>0 && memory_limit>cgroup_memory) memory_limit = cgroup_memory;
+    memory_ceiling = (unsigned long long)(memory_limit * GIGAOCTET);
+    // remove what is already used (vocabulary) and what threads need besides buffers
+    const unsigned long long process_memory = get_process_memory();
+    const unsigned long long thread_memory = (unsigned long long)num_threads * (MAX_TOKEN_PER_LINE*sizeof(unsigned int)
+                                           + num_windows * (SPILL_BLOCK_SIZE + ((compress_tmp) ? compressBound(SPILL_BLOCK_SIZE) : 0)));
+    base_memory = process_memory + thread_memory;
+    long long buffer_budget = (long long)(0.7 * memory_ceiling) - (long long)base_memory;
+    // keep at least a few thousand records per buffer
+    const long long min_budget = (long long)num_threads * num_windows * 2 * 4096 * sizeof(cooccur_t);
+    if (buffer_budget < min_budget){
+        fprintf(stderr, "WARNING: -memory %.3f GB leaves no room for cooccurrence buffers, the limit cannot hold\n", memory_limit);
+        buffer_budget = min_budget;
+    }
+    const unsigned long long max_cooccur_size = (unsigned long long)buffer_budget / sizeof(cooccur_t) / num_threads;
+    if (verbose){
+        fprintf(stderr, "memory limit                                  = %.3f GB\n", memory_limit);
+        fprintf(stderr, "memory used before counting                   = %.3f GB\n", (float)process_memory/GIGAOCTET);
+        fprintf(stderr, "initial memory for cooccurrence buffers       = %.3f GB\n", (float)buffer_budget/GIGAOCTET);
+    }
+    // share memory between windows according to the number of records they produce
+    int sum_cxt_size=0;
+    for (int w=0; w<num_windows; w++) sum_cxt_size += windows[w].cxt_size;
+    for (int w=0; w<num_windows; w++){
+        window_t *win = &windows[w];
+        win->max_cooccur_size = max_cooccur_size * win->cxt_size / sum_cxt_size;
+        win->min_buffer_size = (win->max_cooccur_size/16 > (unsigned long long)(4096+4*win->cxt_size)) ? win->max_cooccur_size/16 : (unsigned long long)(4096+4*win->cxt_size);
+        win->max_buffer_size = (unsigned long long)(0.9*memory_ceiling/sizeof(cooccur_t)/(2*num_threads)) * win->cxt_size / sum_cxt_size;
+        if (win->max_buffer_size < win->min_buffer_size) win->max_buffer_size = win->min_buffer_size;
+        win->kernel = select_kernel(win);
+        // dynamic context weights
+        for (int d=1; d<=win->cxt_size; d++) win->weights[d] = (win->dyn_cxt) ? (float)(win->cxt_size-d+1)/win->cxt_size : 1.0;
+        // set number of file per thread
+        win->nfile = (int*)calloc(num_threads, sizeof(int));
+        win->mem_runs = (cooccur_t**)calloc(num_threads, sizeof(cooccur_t*));
+        win->mem_length = (unsigned long long*)calloc(num_threads, sizeof(unsigned long long));
+        win->mem_capacity = (unsigned long long*)calloc(num_threads, sizeof(unsigned long long));
+        win->resume_pos = (long int*)malloc(num_threads*sizeof(long int));
+        win->resume_j = (int*)calloc(num_threads, sizeof(int));
+        for (int t=0; t<num_threads; t++) win->resume_pos[t] = -1;
+        win->tokenfound = (int*)calloc(vocab_size, sizeof(int));
+        if (update) check_options(win);
+        else win->corpus_files = strdup(c_input_file_name);
+    }
+
+    // record progress in a manifest
+    if (resume){
+        resume_windows();
+        manifest = fopen(c_manifest_file_name, "a");
+    }else{
+        for (int w=0; w<num_windows; w++) for (int t=0; t<num_threads; t++) remove_runs(&windows[w], t, 0);
+        manifest = fopen(c_manifest_file_name, "w");
+        if (manifest){
+            fprintf(manifest, "%sSPLIT %d", header.c_str(), num_threads);
+            for (int t=0; t<=num_threads; t++) fprintf(manifest, " %ld", input_file.flines[t]);
+            fprintf(manifest, "\n");
+            fflush(manifest);
+        }
+    }
+    if (manifest == NULL) fprintf(stderr, "WARNING: unable to write manifest %s, run cannot be resumed\n", c_manifest_file_name);
 
     // launch threads
-    threads.linear( cooccurrence, input_file.flines );
+    if (sketch_threshold>0) sketch_windows(threads, input_file.flines, buffer_budget/2);
+    else threads.linear( cooccurrence, input_file.flines );
+    if (verbose){
+        fprintf(stderr, "\npeak memory of cooccurrence buffers           = %.3f GB\n", (float)peak_buffer_memory/GIGAOCTET);
+        if (peak_process_memory) fprintf(stderr, "peak memory of the process                    = %.3f GB\n", (float)peak_process_memory/GIGAOCTET);
+    }
 
-    // merge temporary files
-    merge_files(num_threads);
+    for (int w=0; w<num_windows; w++){
+        if (!windows[w].merged){
+            if (verbose && num_windows>1) fprintf(stderr, "\nwindow configuration: cxt-size=%d, dyn-cxt=%d", windows[w].cxt_size, windows[w].dyn_cxt);
+            // merge temporary files
+            if (sketch_threshold>0) write_sketched(&windows[w], num_threads);
+            else merge_files(&windows[w], num_threads);
 
-    // write vocabularies
-    write_vocab();
+            // write vocabularies
+            write_vocab(&windows[w]);
+            write_manifest("MERGED %d\n", w);
+        }
+
+        // free
+        free(windows[w].nfile);
+        free(windows[w].mem_runs);
+        free(windows[w].mem_length);
+        free(windows[w].mem_capacity);
+        free(windows[w].resume_pos);
+        free(windows[w].resume_j);
+        free(windows[w].tokenfound);
+    }
 
     // free
-    free(nfile);
-    free(tokenfound);
+    if (hash_cxt){
+        free(cxt_map);
+        if (cxt_sign) free(cxt_sign);
+    }else if (predefined_context){
+        free(cxt_map);
+        free(cxt_inv);
+    }
+    if (sample_keep) free(sample_keep);
     for (int i=0; i<vocab_size; i++) if (tokename[i]) free(tokename[i]);
     free(tokename);
 
     return 0;
 }
 
-void write_options(){
+void write_options(const window_t *win){
+    const char *c_output_dir_name = win->output_dir_name;
     char *c_options_file_name = get_full_path(c_output_dir_name, "options.txt");
     FILE *fopt = fopen(c_options_file_name, "w");
     
@@ -451,9 +1563,13 @@ void write_options(){
     fprintf(fopt, "# general options     #\n");
     fprintf(fopt, "#######################\n");
     fprintf(fopt, "EXP_DIR=%s\n",c_output_dir_name);
-    fprintf(fopt, "CORPUS_FILE=%s\n",c_input_file_name);
+    fprintf(fopt, "CORPUS_FILE=%s\n",win->corpus_files);
     fprintf(fopt, "VOCAB_FILE=%s\n",c_vocab_file_name);
+    fprintf(fopt, "VOCAB_CRC32=%lu\n",vocab_crc);
     fprintf(fopt, "CXT_FILE=%s\n",c_context_file_name);
+    if (predefined_context) fprintf(fopt, "CXT_CRC32=%lu\n",cxt_crc);
+    fprintf(fopt, "TARGET_FILE=%s\n",c_target_file_name);
+    if (predefined_target) fprintf(fopt, "TARGET_CRC32=%lu\n",target_crc);
     fprintf(fopt, "VERBOSE=%d\n",verbose);
     fprintf(fopt, "NUM_THREADS=%d\n\n",num_threads);
 
@@ -464,8 +1580,32 @@ void write_options(){
     fprintf(fopt, "VOCAB_MIN_COUNT=%d\n",min_freq);
     fprintf(fopt, "CONTEXT_VOCAB_UPPER_BOUND_FREQ=%f\n",upper_bound);
     fprintf(fopt, "CONTEXT_VOCAB_LOWER_BOUND_FREQ=%f\n",lower_bound);
-    fprintf(fopt, "DYN_CXT=%d\n",dyn_cxt);
-    fprintf(fopt, "WINDOW_SIZE=%d\n",cxt_size);
+    fprintf(fopt, "DYN_CXT=%d\n",win->dyn_cxt);
+    fprintf(fopt, "WINDOW_SIZE=%d\n",win->cxt_size);
+    fprintf(fopt, "SAMPLE=%e\n",sample);
+    fprintf(fopt, "SYMMETRIC=%d\n",symmetric);
+    fprintf(fopt, "HASH_CXT=%d\n",hash_cxt);
+    fprintf(fopt, "HASH_SIGN=%d\n",hash_sign);
+    fprintf(fopt, "CONTEXT_COLUMNS=%d\n",num_columns());
+    if (hash_cxt) fprintf(fopt, "HASH_FUNCTION=fnv1a64-fmix64\n");
+    fprintf(fopt, "MIN_PAIR_COUNT=%f\n",(partial) ? 0 : std::max(min_pair_count, sketch_threshold));
+    fprintf(fopt, "TOP_K=%d\n",(partial) ? 0 : top_k);
+    fprintf(fopt, "COMPRESS_TMP=%d\n",compress_tmp);
+    if (sketch_threshold>0){
+        // counts kept are exact, the sketch only selects the pairs counted in the second pass:
+        // with probability SKETCH_CONFIDENCE, a sketched count exceeds the actual one by at most SKETCH_ERROR_BOUND
+        fprintf(fopt, "SKETCH=%f\n",sketch_threshold);
+        fprintf(fopt, "SKETCH_DEPTH=%d\n",SKETCH_DEPTH);
+        fprintf(fopt, "SKETCH_WIDTH=%llu\n",win->sketch_width);
+        fprintf(fopt, "SKETCH_ERROR_BOUND=%f\n",M_E*win->sketch_total/win->sketch_width);
+        fprintf(fopt, "SKETCH_CONFIDENCE=%f\n",1-exp(-SKETCH_DEPTH));
+        fprintf(fopt, "SKETCH_CANDIDATES=%llu\n",win->sketch_candidates);
+        fprintf(fopt, "SKETCH_MEAN_ERROR=%f\n",win->sketch_mean_error);
+    }
+    if (partial){
+        fprintf(fopt, "PARTIAL=1\n");
+        fprintf(fopt, "SHARD=%d/%d\n",shard_id,num_shards);
+    }
 
     fclose(fopt);
     free(c_options_file_name);
@@ -474,9 +1614,11 @@ void write_options(){
 
 int main(int argc, char **argv) {
     int i;
+    std::vector<int> cxt_sizes(1, 5), dyn_cxts(1, false);
     c_input_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
     c_vocab_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
     c_context_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
+    c_target_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
     c_output_dir_name = (char*)malloc(sizeof(char) * MAX_PATH_NAME);
 
     if (argc == 1) {
@@ -491,6 +1633,8 @@ int main(int argc, char **argv) {
         printf("\t\tVocabulary file\n");
         printf("\t-cxt-file <file>\n");
         printf("\t\tContext vocabulary file\n");
+        printf("\t-target-file <file>\n");
+        printf("\t\tTarget vocabulary file, to count only the rows of these words whatever their frequency\n");
         printf("\t-output-dir <dir>\n");
         printf("\t\tOutput directory name to save files\n");
         printf("\t-min-freq <int>\n");
@@ -499,14 +1643,45 @@ int main(int argc, char **argv) {
         printf("\tDiscarding words from the context vocabulary with a upper appearance frequency (default is 1.0). Only used when cxt-file is empty\n");
         printf("\t-lower-bound <float>\n");
         printf("\tDiscarding words from the context vocabulary with a lower appearance frequency (default is 0.00001).Only used when cxt-file is empty\n");
-        printf("\t-cxt-size <int>\n");
+        printf("\t-cxt-size <int>[,<int>...]\n");
         printf("\tSymmetric context size around words (default is 5)\n");
-        printf("\t-dyn-cxt <int>\n");
+        printf("\t-dyn-cxt <int>[,<int>...]\n");
         printf("\t\tDynamic context window, i.e. weighting by distance form the focus word: 0=off (default), 1=on\n");
+        printf("\t\tWhen several values are given for -cxt-size and/or -dyn-cxt, every combination is counted from\n");
+        printf("\t\ta single pass over the corpus and saved in <output-dir>/cxt<size>-dyn<0|1>\n");
+        printf("\t-sample <float>\n");
+        printf("\t\tThreshold for subsampling frequent words before counting, as in word2vec, e.g. 1e-5; default is 0 (off)\n");
+        printf("\t-symmetric <int>\n");
+        printf("\t\tRecord each pair of words which are both target and context words once, and mirror it when merging: 0=off (default), 1=on\n");
+        printf("\t-hash-cxt <int>\n");
+        printf("\t\tHash context words into this number of columns, whatever the size of the context vocabulary; default is 0 (off)\n");
+        printf("\t-hash-sign <int>\n");
+        printf("\t\tAdd hashed context words with a random sign, so that collisions cancel out on average: 0=off (default), 1=on\n");
+        printf("\t-min-pair-count <float>\n");
+        printf("\t\tDrop pairs counted less than this value from the final matrix, row sums still include them; default is 0 (keep all)\n");
+        printf("\t-top-k <int>\n");
+        printf("\t\tKeep only the k most frequent contexts of each target word, row sums still include the others; default is 0 (keep all)\n");
+        printf("\t-sketch <float>\n");
+        printf("\t\tApproximate mode in two passes without temporary files: pairs are added to a count-min sketch, then only those whose\n");
+        printf("\t\tsketched count reaches this value are counted exactly, the others are dropped; default is 0 (exact counts)\n");
         printf("\t-memory <float>\n");
-        printf("\t\tSoft limit for memory consumption, in GB -- based on simple heuristic, so not extremely accurate; default 4.0\n");
+        printf("\t\tLimit for memory consumption, in GB -- buffers are resized according to the resident memory of the process; default 4.0\n");
+        printf("\t-compress-tmp <int>\n");
+        printf("\t\tDeflate temporary files on top of their varint encoding: 0=off (default), 1=on\n");
+        printf("\t-tmp-dirs <dir>[,<dir>...]\n");
+        printf("\t\tScratch directories for temporary files, used in turn, e.g. one per local disk; default is output-dir\n");
         printf("\t-threads <int>\n");
         printf("\t\tNumber of threads; default 8\n");
+        printf("\t-resume <int>\n");
+        printf("\t\tResume an interrupted run from the manifest saved in output-dir: 0=off (default), 1=on\n");
+        printf("\t\tThe same options and number of threads must be given\n");
+        printf("\t-partial <int>\n");
+        printf("\t\tSave a partial count in cooccurrence.part, to be merged with other ones by cooccurrence-merge: 0=off (default), 1=on\n");
+        printf("\t-shard <int>/<int>\n");
+        printf("\t\tCount only the i-th of n byte ranges of the input file, e.g. 0/4, and save a partial count\n");
+        printf("\t-update <int>\n");
+        printf("\t\tCount only the input file and merge it into the cooccurrences already saved in output-dir: 0=off (default), 1=on\n");
+        printf("\t\tThe vocabulary and the counting options must be the same as for the previous run\n");
         printf("\nExample usage:\n");
         printf("./cooccurrence -input-file data -vocab-file vocab.txt -output-dir path_to_dir -min-freq 100 -cxt-size 5 -dyn-cxt 1 -memory 4.0 -upper-bound 1.0 -lower-bound 0.00001 -verbose 1 -threads 4\n\n");
         return 0;
@@ -524,21 +1699,43 @@ int main(int argc, char **argv) {
     if ((i = find_arg((char *)"-min-freq", argc, argv)) > 0) min_freq = atoi(argv[i + 1]);
     if ((i = find_arg((char *)"-upper-bound", argc, argv)) > 0) upper_bound = atof(argv[i + 1]);
     if ((i = find_arg((char *)"-lower-bound", argc, argv)) > 0) lower_bound = atof(argv[i + 1]);
-    if ((i = find_arg((char *)"-cxt-size", argc, argv)) > 0) cxt_size = atoi(argv[i + 1]);
-    if ((i = find_arg((char *)"-dyn-cxt", argc, argv)) > 0) dyn_cxt = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-cxt-size", argc, argv)) > 0) cxt_sizes = split_int(argv[i + 1]);
+    if ((i = find_arg((char *)"-dyn-cxt", argc, argv)) > 0) dyn_cxts = split_int(argv[i + 1]);
     if ((i = find_arg((char *)"-memory", argc, argv)) > 0) memory_limit = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-sample", argc, argv)) > 0) sample = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-symmetric", argc, argv)) > 0) symmetric = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-min-pair-count", argc, argv)) > 0) min_pair_count = atof(argv[i + 1]);
+    if ((i = find_arg((char *)"-top-k", argc, argv)) > 0) top_k = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-hash-cxt", argc, argv)) > 0) hash_cxt = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-hash-sign", argc, argv)) > 0) hash_sign = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-sketch", argc, argv)) > 0) sketch_threshold = atof(argv[i + 1]);
     if ((i = find_arg((char *)"-threads", argc, argv)) > 0) num_threads = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-compress-tmp", argc, argv)) > 0) compress_tmp = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-update", argc, argv)) > 0) update = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-resume", argc, argv)) > 0) resume = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-partial", argc, argv)) > 0) partial = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-shard", argc, argv)) > 0){
+        if ( sscanf(argv[i + 1], "%d/%d", &shard_id, &num_shards) != 2 || num_shards<=0 || shard_id<0 || shard_id>=num_shards ){
+            throw std::runtime_error("-shard must be given as i/n with 0 <= i < n !!");
+        }
+        partial = 1;
+    }
     if ((i = find_arg((char *)"-output-dir", argc, argv)) > 0) strcpy(c_output_dir_name, argv[i + 1]);
     else strcpy(c_output_dir_name, (char *)".");
     if ((i = find_arg((char *)"-vocab-file", argc, argv)) > 0) strcpy(c_vocab_file_name, argv[i + 1]);
     else strcpy(c_vocab_file_name, (char *)"vocab.txt");
     if ((i = find_arg((char *)"-cxt-file", argc, argv)) > 0) strcpy(c_context_file_name, argv[i + 1]);
     else strcpy(c_context_file_name, (char *)"none");
+    if ((i = find_arg((char *)"-target-file", argc, argv)) > 0) strcpy(c_target_file_name, argv[i + 1]);
+    else strcpy(c_target_file_name, (char *)"none");
     if ((i = find_arg((char *)"-input-file", argc, argv)) > 0) strcpy(c_input_file_name, argv[i + 1]);
+    if ((i = find_arg((char *)"-tmp-dirs", argc, argv)) > 0) tmp_dirs = split(argv[i + 1], ',');
 
     /* check whether output directory exists */
     is_directory(c_output_dir_name);
-    c_output_file_name = get_full_path(c_output_dir_name, "cooccurrence");
+    /* check whether scratch directories exist */
+    for (size_t d=0; d<tmp_dirs.size(); d++) is_directory(tmp_dirs[d].c_str());
+    if (!tmp_dirs.empty()) num_tmp_dirs = tmp_dirs.size();
 
     /* check whether input file exists */
     is_file(c_input_file_name);
@@ -558,27 +1755,119 @@ int main(int argc, char **argv) {
           throw std::runtime_error("-lower-bound value must be lower than -upper-bound value !!");
       }
     }
+    if (strcmp(c_target_file_name, "none") != 0){ /* count only a predefined list of target words */
+      is_file(c_target_file_name);
+      predefined_target=1;
+    }
     if ( memory_limit<=0 ){
         throw std::runtime_error("-memory must be a positive integer (number of GB) !!");
     }
-    if ( cxt_size<=0 ){
-        throw std::runtime_error("-cxt-size must be a positive integer !!");
+    if ( cxt_sizes.empty() || dyn_cxts.empty() ){
+        throw std::runtime_error("-cxt-size and -dyn-cxt cannot be empty !!");
+    }
+    for (size_t c=0; c<cxt_sizes.size(); c++){
+        if ( cxt_sizes[c]<=0 || cxt_sizes[c]>MAX_CXT_SIZE ){
+            throw std::runtime_error("-cxt-size must be a positive integer lower than " + typeToString(MAX_CXT_SIZE+1) + " !!");
+        }
+    }
+    for (size_t d=0; d<dyn_cxts.size(); d++){
+        if ( dyn_cxts[d]!=0 && dyn_cxts[d]!=1 ){
+            throw std::runtime_error("-dyn-cxt must be 0 or 1 !!");
+        }
     }
     if ( min_freq<=0 ){
         throw std::runtime_error("-min-freq must be a positive integer !!");
     }
+    if ( sample<0 ){
+        throw std::runtime_error("-sample must be a positive value !!");
+    }
+    if ( hash_cxt<0 ){
+        throw std::runtime_error("-hash-cxt must be a positive integer !!");
+    }
+    if ( hash_sign && !hash_cxt ){
+        throw std::runtime_error("-hash-sign requires -hash-cxt !!");
+    }
+    if ( symmetric && hash_cxt ){
+        throw std::runtime_error("-symmetric cannot be used with -hash-cxt, hashed columns cannot be mirrored !!");
+    }
+    if ( symmetric && predefined_target ){
+        throw std::runtime_error("-symmetric cannot be used with -target-file, rows are no longer token ids !!");
+    }
+    if ( partial && predefined_target ){
+        throw std::runtime_error("-target-file cannot be used with a partial count !!");
+    }
+    if ( min_pair_count<0 || top_k<0 ){
+        throw std::runtime_error("-min-pair-count and -top-k must be positive values !!");
+    }
+    if ( sketch_threshold<0 ){
+        throw std::runtime_error("-sketch must be a positive value !!");
+    }
+    if ( sketch_threshold>0 && (symmetric || hash_sign) ){
+        throw std::runtime_error("-sketch cannot be used with -symmetric or -hash-sign !!");
+    }
+    if ( sketch_threshold>0 && (partial || update || resume) ){
+        throw std::runtime_error("-sketch cannot be used with -partial, -update or -resume !!");
+    }
+    if ( partial && update ){
+        throw std::runtime_error("-update cannot be used with a partial count, use cooccurrence-merge instead !!");
+    }
+
+    /* the manifest records completed work until the end of the run */
+    c_manifest_file_name = get_full_path(c_output_dir_name, "cooccurrence.manifest");
+
+    /* define window configurations */
+    num_windows = cxt_sizes.size()*dyn_cxts.size();
+    windows = (window_t*)calloc(num_windows, sizeof(window_t));
+    for (size_t c=0, w=0; c<cxt_sizes.size(); c++){
+        for (size_t d=0; d<dyn_cxts.size(); d++, w++){
+            windows[w].cxt_size = cxt_sizes[c];
+            windows[w].dyn_cxt = dyn_cxts[d];
+            const std::string name = "cxt" + typeToString(cxt_sizes[c]) + "-dyn" + typeToString(dyn_cxts[d]);
+            if (num_windows == 1){
+                windows[w].output_dir_name = strdup(c_output_dir_name);
+            }else{ // one sub-directory per configuration
+                windows[w].output_dir_name = get_full_path(c_output_dir_name, name.c_str());
+                create_directory(windows[w].output_dir_name);
+            }
+            windows[w].output_file_name = get_full_path(windows[w].output_dir_name, "cooccurrence");
+            // spill runs go to the scratch directories, with the same layout
+            windows[w].tmp_file_names = (char**)malloc(sizeof(char*)*num_tmp_dirs);
+            if (tmp_dirs.empty()) windows[w].tmp_file_names[0] = strdup(windows[w].output_file_name);
+            for (size_t t=0; t<tmp_dirs.size(); t++){
+                char *tmp_dir_name = (num_windows == 1) ? strdup(tmp_dirs[t].c_str()) : get_full_path(tmp_dirs[t].c_str(), name.c_str());
+                create_directory(tmp_dir_name);
+                windows[w].tmp_file_names[t] = get_full_path(tmp_dir_name, "cooccurrence");
+                free(tmp_dir_name);
+            }
+        }
+    }
 
     run();
 
     /* write out options */
-    write_options();
+    for (int w=0; w<num_windows; w++) write_options(&windows[w]);
+
+    /* the run is complete, nothing to resume */
+    if (manifest){
+        fclose(manifest);
+        remove(c_manifest_file_name);
+    }
+    free(c_manifest_file_name);
 
     /* release memory */
     free(c_input_file_name);
     free(c_vocab_file_name);
     free(c_context_file_name);
+    free(c_target_file_name);
     free(c_output_dir_name);
-    free(c_output_file_name);
+    for (int w=0; w<num_windows; w++){
+        free(windows[w].output_dir_name);
+        free(windows[w].output_file_name);
+        for (int d=0; d<num_tmp_dirs; d++) free(windows[w].tmp_file_names[d]);
+        free(windows[w].tmp_file_names);
+        free(windows[w].corpus_files);
+    }
+    free(windows);
 
     if (verbose){
         fprintf(stderr, "\ndone\n");
@@ -64,7 +64,7 @@ int lower=true;
 int num_threads=8;
 char *c_word_file_name, *c_vocab_file_name;
 // variable for handling vocab
-vocab hash;
+vocab_ids hash;
 int vocab_size;
 
 /* ranking by values */
@@ -132,7 +132,7 @@ void runsimilarity(
 
     int itr=0;
     int n=0;
-    vocab::iterator i,j;
+    vocab_ids::iterator i,j;
     std::vector<int> idx1, idx2;
     std::vector<float> tmp;
     while ((buffer = string_copy(buffer, ptr_data, &itr, '\n')) != '\0') {
@@ -224,7 +224,7 @@ float const runanalogy(
     char token2[MAX_TOKEN];
     char token3[MAX_TOKEN];
     char token4[MAX_TOKEN];
-    vocab::iterator i,j,k,l;
+    vocab_ids::iterator i,j,k,l;
     int itr=0;
 
     std::vector<int> a,b,c,d,idx;
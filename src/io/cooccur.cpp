@@ -20,26 +20,178 @@
 #include "cooccur.h"
 
 // C++ header
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
 
+// C header
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 // include utility headers
 #include "../util/constants.h"
 #include "../util/data.h"
+#include "../util/csr.h"
+
+// read cooccurrence matrix stored in CSR layout
+/* number of records scanned by each task of the flat file loader */
+#define RECORD_CHUNK_SIZE 1048576
+/* number of bytes of a mapped file read before their pages are released */
+#define RELEASE_SIZE 16777216
+
+// map a whole cooccurrence file in memory
+static const char *map_cooccurrence(const char* c_input_file_name, size_t *size){
+    const int fd = open(c_input_file_name, O_RDONLY);
+    if (fd < 0){
+      std::string err = "Unable to open file " + std::string(c_input_file_name) + "!";
+      throw std::runtime_error(err);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    *size = st.st_size;
+    if (*size == 0){
+        close(fd);
+        throw std::runtime_error("empty cooccurrence file " + std::string(c_input_file_name) + "!!");
+    }
+    void *map = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED){
+        throw std::runtime_error("Unable to map file " + std::string(c_input_file_name) + "!!");
+    }
+    // every page is read once, by the thread in charge of its rows
+    madvise(map, *size, MADV_WILLNEED);
+    return (const char*)map;
+}
+
+static int const read_csr_cooccurrence(
+      const char *map
+    , const size_t size
+    , const csr_header_t &h
+    , REDSVD::SMatrixXf& A
+    , const int verbose
+){
+    if (verbose) fprintf(stderr, "# of words:%llu, # of context words:%llu, # of non-zero entries:%llu\n", h.rows, h.cols, h.nnz);
+    typedef REDSVD::SMatrixXf::Index Index;
+    if (h.nnz > (unsigned long long)std::numeric_limits<Index>::max() || h.cols > INT_MAX){
+        throw std::runtime_error("cooccurrence matrix too large for 32-bit sparse indices, rebuild with -DHPCA_64BIT_INDEX=ON !!");
+    }
+    if (size < csr_val_offset(&h) + sizeof(float)*h.nnz){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    if (verbose) fprintf(stderr, "Storing cooccurrence matrix in memory...");
+
+    // arrays of the file, copied once into the matrix
+    const unsigned long long *row_ptr = (const unsigned long long*)(map + csr_row_ptr_offset());
+    const float *rowsum = (const float*)(map + csr_rowsum_offset(&h));
+    const unsigned int *col = (const unsigned int*)(map + csr_col_offset(&h));
+    const float *fval = (const float*)(map + csr_val_offset(&h));
+    A.resize(h.rows, h.cols);
+    A.resizeNonZeros(h.nnz);
+    Index *outer = A.outerIndexPtr();
+    Index *inner = A.innerIndexPtr();
+    float *val = A.valuePtr();
+    const long int nrow = h.rows;
+    // rows are independent
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (long int r=0; r<nrow; r++){
+        outer[r] = (Index)row_ptr[r];
+        for (unsigned long long k=row_ptr[r]; k<row_ptr[r+1]; k++) inner[k] = col[k];
+        memcpy(val+row_ptr[r], fval+row_ptr[r], sizeof(float)*(row_ptr[r+1]-row_ptr[r]));
+    }
+    outer[nrow] = (Index)row_ptr[nrow];
+    hellinger_transform(A, rowsum);
 
-// read cooccurence triplets
+    return h.cols;
+}
+
+// read a flat file of cooccurrence records, sorted by target word
+static int const read_flat_cooccurrence(
+      const char *map
+    , const size_t size
+    , REDSVD::SMatrixXf& A
+    , const int verbose
+){
+    typedef REDSVD::SMatrixXf::Index Index;
+    if (size % sizeof(cooccur_t) != 0){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    const cooccur_t *rec = (const cooccur_t*)map;
+    const unsigned long long nrec = size / sizeof(cooccur_t);
+    const long int nchunk = (nrec + RECORD_CHUNK_SIZE - 1) / RECORD_CHUNK_SIZE;
+
+    // count the rows starting in each chunk of records
+    std::vector<unsigned long long> chunk_row(nchunk+1, 0);
+    std::vector<unsigned int> chunk_maxid(nchunk, 0);
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long int c=0; c<nchunk; c++){
+        const unsigned long long end = std::min(nrec, (unsigned long long)(c+1)*RECORD_CHUNK_SIZE);
+        unsigned long long n = 0;
+        unsigned int maxid = 0;
+        for (unsigned long long k=(unsigned long long)c*RECORD_CHUNK_SIZE; k<end; k++){
+            if (k==0 || rec[k].idx1 != rec[k-1].idx1) n++;
+            if (rec[k].idx2 > maxid) maxid = rec[k].idx2;
+        }
+        chunk_row[c+1] = n;
+        chunk_maxid[c] = maxid;
+    }
+    unsigned int maxid = 0;
+    for (long int c=0; c<nchunk; c++){
+        chunk_row[c+1] += chunk_row[c];
+        if (chunk_maxid[c] > maxid) maxid = chunk_maxid[c];
+    }
+    const long int nrow = chunk_row[nchunk];
+    const int ncontext = maxid+1;
+    if (verbose) fprintf(stderr, "# of words:%ld, # of context words:%d, # of non-zero entries:%lld\n", nrow, ncontext, nrec);
+    if (nrec > (unsigned long long)std::numeric_limits<Index>::max()){
+        throw std::runtime_error("cooccurrence matrix too large for 32-bit sparse indices, rebuild with -DHPCA_64BIT_INDEX=ON !!");
+    }
+
+    if (verbose) fprintf(stderr, "Storing cooccurrence matrix in memory...");
+
+    // store cooccurrence in Eigen sparse matrix object
+    A.resize(nrow, ncontext);
+    A.resizeNonZeros(nrec);
+    Index *outer = A.outerIndexPtr();
+    Index *inner = A.innerIndexPtr();
+    float *val = A.valuePtr();
+    // row boundaries, each chunk fills its own rows
+    #pragma omp parallel for schedule(dynamic, 1)
+    for (long int c=0; c<nchunk; c++){
+        const unsigned long long end = std::min(nrec, (unsigned long long)(c+1)*RECORD_CHUNK_SIZE);
+        unsigned long long r = chunk_row[c];
+        for (unsigned long long k=(unsigned long long)c*RECORD_CHUNK_SIZE; k<end; k++){
+            if (k==0 || rec[k].idx1 != rec[k-1].idx1) outer[r++] = (Index)k;
+        }
+    }
+    outer[nrow] = (Index)nrec;
+    // rows are independent
+    std::vector<float> rowsum(nrow);
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for (long int r=0; r<nrow; r++){
+        float s = 0;
+        for (Index k=outer[r]; k<outer[r+1]; k++){
+            inner[k] = rec[k].idx2;
+            val[k] = rec[k].val;
+            s += rec[k].val;
+        }
+        rowsum[r] = s;
+    }
+    hellinger_transform(A, &rowsum[0]);
+
+    return ncontext;
+}
+
+// read cooccurrence matrix, mapped in memory and loaded by parallel row ranges
 int const read_cooccurrence(
       const char* c_input_file_name
     , REDSVD::SMatrixXf& A
     , const int verbose
 ){
-    int nrow = 0;
-    unsigned long long nonZeroNum = 0;
     const double start = REDSVD::Util::getSec();
-    // read and store cooccurrence data
-    cooccur_t data;
-    // vector to store rowsum
-    std::vector<float> rowsum;
-    float s=0;
     // open file
     FILE *fin = fopen(c_input_file_name,"rb");
     if(fin == NULL) {
@@ -47,56 +199,332 @@ int const read_cooccurrence(
       throw std::runtime_error(err);
     }
     if (verbose) fprintf(stderr, "Reading cooccurrence file %s.\n",c_input_file_name);
-    // read to get information on data
-    fread(&data, sizeof(cooccur_t), 1, fin);
-    ++nrow; ++nonZeroNum;
-    unsigned int current_idx = data.idx1;
-    unsigned int maxid = data.idx2;
-    s+=data.val;
-    while(true){
-        fread(&data, sizeof(cooccur_t), 1, fin);
-        if(feof(fin)) break;
-        ++nonZeroNum;
-        if (data.idx2>maxid) maxid=data.idx2;
-        if (data.idx1!=current_idx){
-            ++nrow;
-            current_idx=data.idx1;
-            rowsum.push_back(s);
-            s=0; // set sum to 0
-        }
-        s+=data.val;
+    csr_header_t header;
+    const int csr = csr_read_header(fin, &header);
+    fclose(fin);
+    size_t size;
+    const char *map = map_cooccurrence(c_input_file_name, &size);
+    // CSR files, or flat files of cooccurrence records
+    const int ncontext = (csr) ? read_csr_cooccurrence(map, size, header, A, verbose)
+                               : read_flat_cooccurrence(map, size, A, verbose);
+    munmap((void*)map, size);
+
+    if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+
+    return ncontext;
+}
+
+// release the pages of a mapped file read up to end, from the last page released
+static void release_pages(const char *map, const char **released, const char *end){
+    const long int page = sysconf(_SC_PAGESIZE);
+    const char *aligned = map + ((end - map) / page) * page; // the mapping starts on a page
+    if (aligned - *released < RELEASE_SIZE) return;
+    madvise((void*)*released, aligned - *released, MADV_DONTNEED);
+    *released = aligned;
+}
+
+// read the Hellinger rows of a CSR cooccurrence matrix
+static int const read_csr_rows(
+      const char *map
+    , const size_t size
+    , const csr_header_t &h
+    , cooccur_row_sink& sink
+    , const int verbose
+){
+    if (verbose) fprintf(stderr, "# of words:%llu, # of context words:%llu, # of non-zero entries:%llu\n", h.rows, h.cols, h.nnz);
+    if (h.cols > INT_MAX){
+        throw std::runtime_error("cooccurrence matrix too large for 32-bit column indices!!");
+    }
+    if (size < csr_val_offset(&h) + sizeof(float)*h.nnz){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    if (verbose) fprintf(stderr, "Storing cooccurrence matrix in memory...");
+
+    const unsigned long long *row_ptr = (const unsigned long long*)(map + csr_row_ptr_offset());
+    const float *rowsum = (const float*)(map + csr_rowsum_offset(&h));
+    const unsigned int *col = (const unsigned int*)(map + csr_col_offset(&h));
+    const float *fval = (const float*)(map + csr_val_offset(&h));
+    // columns and values are read once, from the start of their pages
+    const long int page = sysconf(_SC_PAGESIZE);
+    const char *col_released = map + (csr_col_offset(&h) / page) * page;
+    const char *val_released = map + (csr_val_offset(&h) / page) * page;
+    sink.resize(h.rows, h.cols, h.nnz);
+    std::vector<float> val;
+    for (unsigned long long r=0; r<h.rows; r++){
+        const unsigned long long n = row_ptr[r+1]-row_ptr[r];
+        val.assign(fval+row_ptr[r], fval+row_ptr[r+1]);
+        transform_row((n>0) ? &val[0] : NULL, n, rowsum[r], hellinger_op());
+        sink.append(col+row_ptr[r], (n>0) ? &val[0] : NULL, n);
+        release_pages(map, &col_released, (const char*)(col+row_ptr[r+1]));
+        release_pages(map, &val_released, (const char*)(fval+row_ptr[r+1]));
     }
-    const int ncontext = maxid+1;
-    if (verbose) fprintf(stderr, "# of words:%d, # of context words:%d, # of non-zero entries:%lld\n", nrow, ncontext, nonZeroNum);
-    // get back at the beginning of the file
-    fseek(fin, 0, SEEK_SET);
 
+    return h.cols;
+}
+
+// read the Hellinger rows of a flat file of cooccurrence records, sorted by target word
+static int const read_flat_rows(
+      const char *map
+    , const size_t size
+    , cooccur_row_sink& sink
+    , const int verbose
+){
+    if (size % sizeof(cooccur_t) != 0){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    const cooccur_t *rec = (const cooccur_t*)map;
+    const unsigned long long nrec = size / sizeof(cooccur_t);
+    // count the rows first
+    long int nrow = 0;
+    unsigned int maxid = 0;
+    for (unsigned long long k=0; k<nrec; k++){
+        if (k==0 || rec[k].idx1 != rec[k-1].idx1) nrow++;
+        if (rec[k].idx2 > maxid) maxid = rec[k].idx2;
+    }
+    const int ncontext = maxid+1;
+    if (verbose) fprintf(stderr, "# of words:%ld, # of context words:%d, # of non-zero entries:%lld\n", nrow, ncontext, nrec);
     if (verbose) fprintf(stderr, "Storing cooccurrence matrix in memory...");
 
-    // store cooccurrence in Eigen sparse matrix object
-    A.resize(nrow, ncontext);
-    A.reserve(nonZeroNum);
-    nrow=0;
-    // read to get information on data
-    fread(&data, sizeof(cooccur_t), 1, fin);
-    current_idx=data.idx1;
-    A.startVec(nrow);
-    A.insertBack(nrow, data.idx2) = sqrtf(data.val/(rowsum[nrow]+EPSILON)); // prevent division by 0 (should not happen anyway)
-    while(true){
-        fread(&data, sizeof(cooccur_t), 1, fin);
-        if(feof(fin)) break;
-        if (data.idx1!=current_idx){
-            A.startVec(++nrow);
-            current_idx=data.idx1;
+    const char *released = map;
+    sink.resize(nrow, ncontext, nrec);
+    std::vector<unsigned int> col;
+    std::vector<float> val;
+    for (unsigned long long k=0; k<nrec; ){
+        col.clear();
+        val.clear();
+        float s = 0;
+        const unsigned int id = rec[k].idx1;
+        for (; k<nrec && rec[k].idx1 == id; k++){
+            col.push_back(rec[k].idx2);
+            val.push_back(rec[k].val);
+            s += rec[k].val;
         }
-        A.insertBack(nrow, data.idx2) = sqrtf(data.val/(rowsum[nrow]+EPSILON));
+        transform_row(&val[0], val.size(), s, hellinger_op());
+        sink.append(&col[0], &val[0], val.size());
+        release_pages(map, &released, (const char*)(rec+k));
     }
-    A.finalize();
 
-    // closing file
+    return ncontext;
+}
+
+// read the Hellinger rows of a cooccurrence matrix, mapped in memory
+int const read_cooccurrence_rows(
+      const char* c_input_file_name
+    , cooccur_row_sink& sink
+    , const int verbose
+){
+    const double start = REDSVD::Util::getSec();
+    // open file
+    FILE *fin = fopen(c_input_file_name,"rb");
+    if(fin == NULL) {
+      std::string err = "Unable to open file " + std::string(c_input_file_name) + "!";
+      throw std::runtime_error(err);
+    }
+    if (verbose) fprintf(stderr, "Reading cooccurrence file %s.\n",c_input_file_name);
+    csr_header_t header;
+    const int csr = csr_read_header(fin, &header);
     fclose(fin);
+    size_t size;
+    const char *map = map_cooccurrence(c_input_file_name, &size);
+    // CSR files, or flat files of cooccurrence records
+    const int ncontext = (csr) ? read_csr_rows(map, size, header, sink, verbose)
+                               : read_flat_rows(map, size, sink, verbose);
+    munmap((void*)map, size);
 
     if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
 
     return ncontext;
 }
+
+// open a cooccurrence matrix with its index
+cooccur_index_t *open_cooccurrence_index(
+      const char* c_input_file_name
+    , const char* c_index_file_name
+){
+    cooccur_index_t *idx = (cooccur_index_t*)calloc(1, sizeof(cooccur_index_t));
+    const int fi = open(c_index_file_name, O_RDONLY);
+    if (fi < 0){
+      std::string err = "Unable to open file " + std::string(c_index_file_name) + "!";
+      throw std::runtime_error(err);
+    }
+    if (!csr_read_index_header(fi, &idx->size, &idx->nnz)){
+        throw std::runtime_error("file " + std::string(c_index_file_name) + " is not a cooccurrence index!!");
+    }
+    idx->map_size = CSR_INDEX_HEADER_SIZE + sizeof(csr_index_entry_t)*idx->size;
+    idx->map = mmap(NULL, idx->map_size, PROT_READ, MAP_SHARED, fi, 0);
+    close(fi);
+    if (idx->map == MAP_FAILED){
+        throw std::runtime_error("Unable to map file " + std::string(c_index_file_name) + "!!");
+    }
+    idx->entries = (const csr_index_entry_t*)((const char*)idx->map + CSR_INDEX_HEADER_SIZE);
+    // the index must describe this very matrix
+    FILE *fin = fopen(c_input_file_name, "rb");
+    if(fin == NULL) {
+      std::string err = "Unable to open file " + std::string(c_input_file_name) + "!";
+      throw std::runtime_error(err);
+    }
+    csr_header_t header;
+    if (!csr_read_header(fin, &header) || header.nnz != idx->nnz){
+        throw std::runtime_error("index " + std::string(c_index_file_name) + " does not match " + std::string(c_input_file_name) + "!!");
+    }
+    fclose(fin);
+    idx->fd = open(c_input_file_name, O_RDONLY);
+    return idx;
+}
+
+// read the row of a target word
+int const read_cooccurrence_row(
+      const cooccur_index_t *idx
+    , const unsigned int id
+    , std::vector<unsigned int>& cols
+    , std::vector<float>& vals
+){
+    cols.clear();
+    vals.clear();
+    if (id >= idx->size || idx->entries[id].length == 0) return 0;
+    const csr_index_entry_t &e = idx->entries[id];
+    cols.resize(e.length);
+    vals.resize(e.length);
+    // values follow the column indices of the whole matrix
+    const ssize_t ncol = sizeof(unsigned int)*e.length, nval = sizeof(float)*e.length;
+    if ( pread(idx->fd, &cols[0], ncol, e.offset) != ncol
+      || pread(idx->fd, &vals[0], nval, e.offset + sizeof(unsigned int)*idx->nnz) != nval ){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    return (int)e.length;
+}
+
+// close a cooccurrence matrix with its index
+void close_cooccurrence_index(cooccur_index_t *idx){
+    munmap(idx->map, idx->map_size);
+    close(idx->fd);
+    free(idx);
+}
+
+/* magic number of Hellinger matrix files */
+static const char HELLINGER_MAGIC[8] = {'H','P','C','A','H','E','L','1'};
+
+// header of a Hellinger matrix file
+struct hellinger_header {
+    char magic[8];
+    unsigned long long rows;
+    unsigned long long cols;
+    unsigned long long nnz;
+    unsigned long long index_size;
+    unsigned long long source_size;
+    unsigned long long source_mtime;
+};
+typedef hellinger_header hellinger_header_t;
+
+// read the header of a Hellinger matrix file, 1 if it has been written from this very cooccurrence file
+static int read_hellinger_header(const char* c_matrix_file_name, const struct stat &src, hellinger_header_t *h){
+    FILE *fin = fopen(c_matrix_file_name, "rb");
+    if (fin == NULL) return 0;
+    const int valid = fread(h, sizeof(hellinger_header_t), 1, fin) == 1
+                   && memcmp(h->magic, HELLINGER_MAGIC, sizeof(HELLINGER_MAGIC)) == 0
+                   && h->index_size == sizeof(REDSVD::SMatrixXf::Index)
+                   && h->source_size == (unsigned long long)src.st_size
+                   && h->source_mtime == (unsigned long long)src.st_mtime;
+    fclose(fin);
+    return valid;
+}
+
+// write the Hellinger matrix of a cooccurrence file, renamed once complete so that
+// concurrent runs never map a partial file
+static void write_hellinger_matrix(
+      const char* c_input_file_name
+    , const char* c_matrix_file_name
+    , const struct stat &src
+    , const int verbose
+){
+    REDSVD::SMatrixXf A;
+    read_cooccurrence(c_input_file_name, A, verbose);
+
+    if (verbose) fprintf(stderr, "Writing Hellinger matrix %s...", c_matrix_file_name);
+    const double start = REDSVD::Util::getSec();
+    char c_pid[32];
+    sprintf(c_pid, ".%d.tmp", (int)getpid());
+    const std::string tmp_file_name = std::string(c_matrix_file_name) + c_pid;
+    FILE *fout = fopen(tmp_file_name.c_str(), "wb");
+    if (fout == NULL){
+      std::string err = "Unable to open file " + tmp_file_name + "!";
+      throw std::runtime_error(err);
+    }
+    char header[HELLINGER_HEADER_SIZE];
+    memset(header, 0, HELLINGER_HEADER_SIZE);
+    hellinger_header_t *h = (hellinger_header_t*)header;
+    memcpy(h->magic, HELLINGER_MAGIC, sizeof(HELLINGER_MAGIC));
+    h->rows = A.rows();
+    h->cols = A.cols();
+    h->nnz = A.nonZeros();
+    h->index_size = sizeof(REDSVD::SMatrixXf::Index);
+    h->source_size = src.st_size;
+    h->source_mtime = src.st_mtime;
+    fwrite(header, HELLINGER_HEADER_SIZE, 1, fout);
+    fwrite(A.outerIndexPtr(), sizeof(REDSVD::SMatrixXf::Index), h->rows+1, fout);
+    fwrite(A.innerIndexPtr(), sizeof(REDSVD::SMatrixXf::Index), h->nnz, fout);
+    fwrite(A.valuePtr(), sizeof(float), h->nnz, fout);
+    const int failed = ferror(fout);
+    if (fclose(fout) != 0 || failed || rename(tmp_file_name.c_str(), c_matrix_file_name) != 0){
+        unlink(tmp_file_name.c_str());
+        throw std::runtime_error("Unable to write file " + std::string(c_matrix_file_name) + "!!");
+    }
+    if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+}
+
+// map the Hellinger matrix of a cooccurrence file, written first when missing or stale
+hellinger_map_t *open_hellinger_map(
+      const char* c_input_file_name
+    , const char* c_matrix_file_name
+    , const int verbose
+){
+    struct stat src;
+    if (stat(c_input_file_name, &src) != 0){
+      std::string err = "Unable to open file " + std::string(c_input_file_name) + "!";
+      throw std::runtime_error(err);
+    }
+    hellinger_header_t h;
+    if (!read_hellinger_header(c_matrix_file_name, src, &h)){
+        write_hellinger_matrix(c_input_file_name, c_matrix_file_name, src, verbose);
+        if (!read_hellinger_header(c_matrix_file_name, src, &h)){
+            throw std::runtime_error("file " + std::string(c_matrix_file_name) + " is not a Hellinger matrix!!");
+        }
+    }
+
+    if (verbose) fprintf(stderr, "Mapping Hellinger matrix %s...", c_matrix_file_name);
+    const double start = REDSVD::Util::getSec();
+    typedef REDSVD::SMatrixXf::Index Index;
+    const size_t outer_size = sizeof(Index)*(h.rows+1), inner_size = sizeof(Index)*h.nnz;
+    hellinger_map_t *hm = (hellinger_map_t*)calloc(1, sizeof(hellinger_map_t));
+    hm->map_size = HELLINGER_HEADER_SIZE + outer_size + inner_size + sizeof(float)*h.nnz;
+    const int fd = open(c_matrix_file_name, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || (size_t)st.st_size < hm->map_size){
+        if (fd >= 0) close(fd);
+        throw std::runtime_error("truncated Hellinger matrix file " + std::string(c_matrix_file_name) + "!!");
+    }
+    // shared with every process mapping the same file
+    hm->map = mmap(NULL, hm->map_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (hm->map == MAP_FAILED){
+        throw std::runtime_error("Unable to map file " + std::string(c_matrix_file_name) + "!!");
+    }
+    madvise(hm->map, hm->map_size, MADV_WILLNEED);
+    char *base = (char*)hm->map + HELLINGER_HEADER_SIZE;
+    hm->rows = h.rows;
+    hm->cols = h.cols;
+    hm->nnz = h.nnz;
+    hm->outer = (Index*)base;
+    hm->inner = (Index*)(base + outer_size);
+    hm->val = (float*)(base + outer_size + inner_size);
+    if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+    if (verbose) fprintf(stderr, "# of words:%ld, # of context words:%ld, # of non-zero entries:%ld\n", hm->rows, hm->cols, hm->nnz);
+
+    return hm;
+}
+
+// unmap a Hellinger matrix
+void close_hellinger_map(hellinger_map_t *hm){
+    munmap(hm->map, hm->map_size);
+    free(hm);
+}
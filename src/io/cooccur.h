@@ -17,12 +17,140 @@
 // You should have received a copy of the GNU General Public License
 // along with HPCA. If not, see <http://www.gnu.org/licenses/>.
 
+ // C++ header
+ #include <algorithm>
+ #include <vector>
+
+ // C header
+ #include <math.h>
+
  // include redsvd headers
  #include "../redsvd/util.h"
 
+ // include utility headers
+ #include "../util/constants.h"
+ #include "../util/csr.h"
+
+ // number of values transformed at once
+ #define TRANSFORM_BLOCK_SIZE 256
+
+ // size of the header of a Hellinger matrix file in bytes
+ #define HELLINGER_HEADER_SIZE 64
+
  // Read matrix from file
  int const read_cooccurrence(
      const char* c_input_file_name
     , REDSVD::SMatrixXf& A
     , const int verbose
 );
+
+ // Apply a row-normalised transform to the n values of a row: a value v becomes
+ // sign(v)*op(|v|/rowsum), op transforms in place a block of normalised values
+ // with vectorized Eigen array operations
+ template <typename Transform>
+ inline void transform_row(float *val, const long int n, const float rowsum, const Transform& op){
+     const float inv = 1.0f/(rowsum+EPSILON); // prevent division by 0 (should not happen anyway)
+     float block[TRANSFORM_BLOCK_SIZE];
+     for (long int start=0; start<n; start+=TRANSFORM_BLOCK_SIZE){
+         const int length = std::min((long int)TRANSFORM_BLOCK_SIZE, n-start);
+         Eigen::Map<Eigen::ArrayXf> x(block, length);
+         x = Eigen::Map<const Eigen::ArrayXf>(val+start, length).abs()*inv;
+         op(x);
+         // the sign of entries hashed with a sign is kept
+         for (int k=0; k<length; k++) val[start+k] = copysignf(block[k], val[start+k]);
+     }
+ }
+
+ // Apply a row-normalised transform to the values of a sparse matrix, in parallel over rows
+ template <typename Transform>
+ void transform_rows(REDSVD::SMatrixXf& A, const float *rowsum, const Transform& op){
+     typedef REDSVD::SMatrixXf::Index Index;
+     const Index *outer = A.outerIndexPtr();
+     float *val = A.valuePtr();
+     const long int nrow = A.rows();
+     #pragma omp parallel for schedule(dynamic, 1024)
+     for (long int r=0; r<nrow; r++) transform_row(val+outer[r], outer[r+1]-outer[r], rowsum[r], op);
+ }
+
+ // Square root of normalised values
+ struct hellinger_op {
+     void operator()(Eigen::Map<Eigen::ArrayXf>& x) const { x = x.sqrt(); }
+ };
+
+ // Hellinger transform of the rows of a sparse matrix, given the sums of its rows
+ inline void hellinger_transform(REDSVD::SMatrixXf& A, const float *rowsum){
+     transform_rows(A, rowsum, hellinger_op());
+ }
+
+ // Receiver of the Hellinger rows of a cooccurrence matrix read one at a time
+ struct cooccur_row_sink {
+     // called once with the size of the matrix, before its rows
+     virtual void resize(const long int rows, const long int cols, const unsigned long long nnz) = 0;
+     // called on every row in order, with its sorted column indices and its values
+     virtual void append(const unsigned int *cols, const float *vals, const long int n) = 0;
+     virtual ~cooccur_row_sink(){}
+ };
+
+ // Read the Hellinger rows of a cooccurrence matrix one at a time, without storing the
+ // matrix: the pages of the mapped file are released once their rows are read
+ int const read_cooccurrence_rows(
+     const char* c_input_file_name
+    , cooccur_row_sink& sink
+    , const int verbose
+);
+
+ // Random access to the rows of a cooccurrence matrix
+ struct cooccur_index {
+     int fd; // cooccurrence file
+     void *map; // mapped index file
+     size_t map_size;
+     const csr_index_entry_t *entries;
+     unsigned long long size; // number of target ids
+     unsigned long long nnz;
+ };
+ typedef cooccur_index cooccur_index_t;
+
+ // Open a cooccurrence matrix with its index
+ cooccur_index_t *open_cooccurrence_index(
+     const char* c_input_file_name
+    , const char* c_index_file_name
+);
+
+ // Read the row of a target word, return its number of non-zero entries
+ int const read_cooccurrence_row(
+     const cooccur_index_t *idx
+    , const unsigned int id
+    , std::vector<unsigned int>& cols
+    , std::vector<float>& vals
+);
+
+ // Close a cooccurrence matrix with its index
+ void close_cooccurrence_index(cooccur_index_t *idx);
+
+ // Hellinger matrix mapped from a file, in the arrays of an Eigen row-major sparse matrix.
+ // The file starts with the magic number HPCAHEL1 followed by the number of rows, columns
+ // and non-zero entries, the size of sparse indices, and the size and modification time
+ // of the cooccurrence file it comes from (64-bit integers), padded to HELLINGER_HEADER_SIZE
+ // bytes, then the rows+1 row pointers, the nnz column indices and the nnz values.
+ struct hellinger_map {
+     void *map; // mapped file
+     size_t map_size;
+     long int rows;
+     long int cols;
+     long int nnz;
+     REDSVD::SMatrixXf::Index *outer;
+     REDSVD::SMatrixXf::Index *inner;
+     float *val;
+ };
+ typedef hellinger_map hellinger_map_t;
+
+ // Map the Hellinger matrix of a cooccurrence file, the matrix file is first written
+ // from the cooccurrence file when missing or older than it
+ hellinger_map_t *open_hellinger_map(
+     const char* c_input_file_name
+    , const char* c_matrix_file_name
+    , const int verbose
+);
+
+ // Unmap a Hellinger matrix
+ void close_hellinger_map(hellinger_map_t *hm);
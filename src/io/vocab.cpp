@@ -26,7 +26,7 @@
 /* load vocabulary */
 int const get_vocab(
       const char* filename
-    , vocab& hash
+    , vocab_ids& hash
   ){
 
     File fp((std::string(filename)));
@@ -21,7 +21,7 @@
 
 int const get_vocab(
       const char* filename
-    , vocab& hash
+    , vocab_ids& hash
 );
 
 char** const get_words(
@@ -47,7 +47,7 @@ int num_threads=8;
 int top=10;
 char *c_word_file_name, *c_vocab_file_name, *c_list_file_name;
 // variable for handling vocab
-vocab hash;
+vocab_ids hash;
 char ** tokename;
 int vocab_size;
 
@@ -66,7 +66,7 @@ void getnn(FILE* fout, Eigen::MatrixXf m, const int idx){
 int main(int argc, char **argv) {
     int i, idx;
     int interact=false;
-    vocab::iterator vocab_itr;
+    vocab_ids::iterator vocab_itr;
 
     c_word_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
     c_list_file_name = (char*)malloc(sizeof(char) * MAX_FULLPATH_NAME);
@@ -30,6 +30,8 @@
 #include "redsvd/util.h"
 #include "redsvd/redsvd.h"
 #include "redsvd/redsvdFile.h"
+#include "redsvd/compact.h"
+#include "redsvd/transposed.h"
 
 // include i/o headers
 #include "io/cooccur.h"
@@ -38,20 +40,111 @@
 int verbose = true; // true or false
 int num_threads=8;
 int rank = 300;
-char *c_input_dir_name, *c_input_file_name;
+int compact = 0; // 16-bit storage of the matrix: 0=off, 1=bfloat16 values, 2=float16 values
+int transpose = 0; // store the transpose of the matrix for A^T products
+int cache = 0; // map the Hellinger matrix cached in hellinger.bin
+char *c_input_dir_name, *c_input_file_name, *c_matrix_file_name;
 
-int run() {
-    // store cooccurrence in Eigen sparse matrix object
-    REDSVD::SMatrixXf A;
-    const int ncontext = read_cooccurrence(c_input_file_name, A, verbose);
+/* check the rank against the number of context words */
+void check_rank(const int ncontext){
     if (rank>ncontext){
         throw std::runtime_error("-rank must be lower than the number of context words!!");
     }
+}
+
+/* memory taken by a matrix with 32-bit values */
+inline double float_memory(const long int rows, const unsigned long long nnz){
+    return sizeof(float)*nnz + sizeof(REDSVD::SMatrixXf::Index)*(nnz+rows+1);
+}
 
+/* run the randomized SVD on a compact matrix */
+template <class Codec>
+void run_compact_svd(const REDSVD::CompactSMatrix<Codec>& C, REDSVD::RedSVD& svd){
     if (verbose) fprintf(stderr, "Running randomized SVD...");
     const double start = REDSVD::Util::getSec();
-    REDSVD::RedSVD svdOfA(A, rank);
+    svd.run(C, rank);
     if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+}
+
+/* run the randomized SVD on a compact copy of a mapped matrix, whose pages are left to the page cache */
+template <class Codec, class Mat>
+void compact_svd(const Mat& A, REDSVD::RedSVD& svd){
+    if (verbose) fprintf(stderr, "Compacting matrix with %s values...", Codec::name());
+    const double start = REDSVD::Util::getSec();
+    REDSVD::CompactSMatrix<Codec> C(A);
+    if (verbose) fprintf(stderr, "done in %.2f, %.1f MB instead of %.1f MB.\n",REDSVD::Util::getSec() - start, (double)C.memory()/MEGAOCTET, float_memory(A.rows(), A.nonZeros())/MEGAOCTET);
+    run_compact_svd(C, svd);
+}
+
+/* compact matrix filled with the rows of the cooccurrence file */
+template <class Codec>
+struct compact_sink : public cooccur_row_sink {
+    REDSVD::CompactSMatrix<Codec> *C;
+    compact_sink() : C(NULL) {}
+    ~compact_sink(){ delete C; }
+    void resize(const long int rows, const long int cols, const unsigned long long nnz){
+        C = new REDSVD::CompactSMatrix<Codec>(rows, cols, nnz);
+    }
+    void append(const unsigned int *cols, const float *vals, const long int n){ C->appendRow(cols, vals, n); }
+};
+
+/* run the randomized SVD on a compact matrix read row by row from the cooccurrence file,
+ * so that the matrix is never stored with 32-bit values */
+template <class Codec>
+void read_compact_svd(REDSVD::RedSVD& svd){
+    if (verbose) fprintf(stderr, "Compacting matrix with %s values.\n", Codec::name());
+    compact_sink<Codec> sink;
+    check_rank(read_cooccurrence_rows(c_input_file_name, sink, verbose));
+    if (verbose) fprintf(stderr, "compact matrix of %.1f MB instead of %.1f MB.\n", (double)sink.C->memory()/MEGAOCTET, float_memory(sink.C->rows(), sink.C->nonZeros())/MEGAOCTET);
+    run_compact_svd(*sink.C, svd);
+}
+
+/* run the randomized SVD with a transposed copy of the matrix */
+template <class Mat>
+void transposed_svd(const Mat& A, REDSVD::RedSVD& svd){
+    if (verbose) fprintf(stderr, "Transposing matrix...");
+    double start = REDSVD::Util::getSec();
+    REDSVD::TransposedSMatrix<Mat> T(A);
+    if (verbose) fprintf(stderr, "done in %.2f, %.1f MB more.\n",REDSVD::Util::getSec() - start, (double)T.memory()/MEGAOCTET);
+
+    if (verbose) fprintf(stderr, "Running randomized SVD...");
+    start = REDSVD::Util::getSec();
+    svd.run(T, rank);
+    if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+}
+
+/* run the randomized SVD on an owned or a mapped matrix */
+template <class Mat>
+void run_svd(Mat& A, REDSVD::RedSVD& svd){
+    if (compact == 1) compact_svd<REDSVD::bf16_codec>(A, svd);
+    else if (compact == 2) compact_svd<REDSVD::fp16_codec>(A, svd);
+    else if (transpose) transposed_svd(A, svd);
+    else{
+        if (verbose) fprintf(stderr, "Running randomized SVD...");
+        const double start = REDSVD::Util::getSec();
+        svd.run(A, rank);
+        if (verbose) fprintf(stderr, "done in %.2f.\n",REDSVD::Util::getSec() - start);
+    }
+}
+
+int run() {
+    // map the cached Hellinger matrix, store the compact matrix read row by row,
+    // or store cooccurrence in Eigen sparse matrix object
+    REDSVD::RedSVD svdOfA;
+    if (cache){
+        hellinger_map_t *hm = open_hellinger_map(c_input_file_name, c_matrix_file_name, verbose);
+        check_rank(hm->cols);
+        REDSVD::MSMatrixXf M(hm->rows, hm->cols, hm->nnz, hm->outer, hm->inner, hm->val);
+        run_svd(M, svdOfA);
+        close_hellinger_map(hm);
+    }
+    else if (compact == 1) read_compact_svd<REDSVD::bf16_codec>(svdOfA);
+    else if (compact == 2) read_compact_svd<REDSVD::fp16_codec>(svdOfA);
+    else{
+        REDSVD::SMatrixXf A;
+        check_rank(read_cooccurrence(c_input_file_name, A, verbose));
+        run_svd(A, svdOfA);
+    }
 
     // set output name
     std::string output_name = std::string(c_input_dir_name) + "/svd";
@@ -76,6 +169,15 @@ int main(int argc, char **argv) {
         printf("\t\tDirectory where to find cooccurrence.bin file\n");
         printf("\t-rank <int>\n");
         printf("\t\tNumber of components to keep; default 300\n");
+        printf("\t-compact <int>\n");
+        printf("\t\tStore the matrix with 16-bit values and delta-coded 16-bit column indices, about half the memory: 0=off (default),\n");
+        printf("\t\t1=bfloat16 values (full range, 8-bit precision), 2=float16 values (11-bit precision, less precise below 6e-5)\n");
+        printf("\t-transpose <int>\n");
+        printf("\t\tStore a transposed copy of the matrix, so that A^T products gather rows in parallel, at the cost of twice the memory:\n");
+        printf("\t\t0=off (default), 1=on\n");
+        printf("\t-cache <int>\n");
+        printf("\t\tMap the Hellinger matrix from hellinger.bin, written next to cooccurrence.bin when missing or older than it,\n");
+        printf("\t\tso that it is loaded without copy and shared by concurrent runs: 0=off (default), 1=on\n");
         printf("\t-threads <int>\n");
         printf("\t\tNumber of threads; default 8\n");
         printf("\nExample usage:\n");
@@ -85,6 +187,9 @@ int main(int argc, char **argv) {
 
     if ((i = find_arg((char *)"-verbose", argc, argv)) > 0) verbose = atoi(argv[i + 1]);
     if ((i = find_arg((char *)"-rank", argc, argv)) > 0) rank = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-compact", argc, argv)) > 0) compact = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-transpose", argc, argv)) > 0) transpose = atoi(argv[i + 1]);
+    if ((i = find_arg((char *)"-cache", argc, argv)) > 0) cache = atoi(argv[i + 1]);
     if ((i = find_arg((char *)"-threads", argc, argv)) > 0) num_threads = atoi(argv[i + 1]);
     if ((i = find_arg((char *)"-input-dir", argc, argv)) > 0) strcpy(c_input_dir_name, argv[i + 1]);
 
@@ -99,6 +204,7 @@ int main(int argc, char **argv) {
     /* check whether input directory exists */
     is_directory(c_input_dir_name);
     c_input_file_name = get_full_path(c_input_dir_name, "cooccurrence.bin");
+    c_matrix_file_name = get_full_path(c_input_dir_name, "hellinger.bin");
 
     /* check whether cooccurrence.bin exists */
     is_file( c_input_file_name );
@@ -108,6 +214,16 @@ int main(int argc, char **argv) {
         throw std::runtime_error("-rank must be a positive integer!!");
     }
 
+    /* check compact value */
+    if ( compact<0 || compact>2 ){
+        throw std::runtime_error("-compact must be 0, 1 or 2!!");
+    }
+
+    /* check transpose value, compact matrices have their own A^T products */
+    if ( transpose && compact ){
+        throw std::runtime_error("-transpose cannot be used with -compact!!");
+    }
+
     /* set the optimal number of threads */
     num_threads = MultiThread::optimal_nb_thread(num_threads, 1, num_threads);
     // set threads
@@ -120,6 +236,7 @@ int main(int argc, char **argv) {
     /* release memory */
     free(c_input_dir_name);
     free(c_input_file_name);
+    free(c_matrix_file_name);
 
     if (verbose){
         fprintf(stderr, "\ndone\n");
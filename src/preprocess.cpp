@@ -47,7 +47,7 @@ void *preprocess( void *p )
     Thread* thread = (Thread*)p;
     const long int start = thread->start();
     const long int end = thread->end();
-    const long int nbop = (end-start)/100;
+    const long int nbop = (((end==FILE_END) ? File(std::string(c_input_file_name)).size() : end)-start)/100;
     // get output file name
     std::string output_file_name = std::string(c_output_file_name);
 
@@ -72,10 +72,11 @@ void *preprocess( void *p )
     long int position=input_file.position();
     int itr=0;
     if (verbose) loadbar(thread->id(), itr, 100);
-    while ( position<end ){
+    while ( position<end && !input_file.eof() ){
 
         // get the line
         line = input_file.getline();
+        if (line == NULL) break; // end of file
 
         // lowercase?
         if (lower) lowercase(line);
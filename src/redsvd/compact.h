@@ -0,0 +1,256 @@
+// Compact storage of sparse matrices for the randomized SVD
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file       compact.h
+ * @author     Remi Lebret
+ * @brief      row-major sparse matrix with 16-bit values and column indices
+ *
+ * Values are stored as 16-bit floats (bfloat16 or IEEE half precision) and
+ * the column indices of each row as 16-bit deltas from the previous column,
+ * a delta of COMPACT_ESCAPE being followed by the absolute column on two
+ * 16-bit words. Hellinger values lie in [0,1] and columns are sorted within
+ * rows, so that most entries take 4 bytes instead of 8.
+ * Products with dense matrices decode the entries on the fly, in one pass
+ * over the matrix and with contiguous rows of the dense factors.
+ */
+
+#ifndef REDSVD_COMPACT_HPP__
+#define REDSVD_COMPACT_HPP__
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+#include "util.h"
+
+/* delta marking an absolute column index */
+#define COMPACT_ESCAPE 0xFFFF
+
+namespace REDSVD {
+
+/**
+ * bfloat16 values: the upper half of a float, same range but 8 bits of precision
+ */
+struct bf16_codec {
+  static const char *name(){ return "bfloat16"; }
+  static unsigned short encode(const float f){
+    unsigned int u;
+    memcpy(&u, &f, sizeof(float));
+    u += 0x7FFF + ((u >> 16) & 1); // round to nearest even
+    return (unsigned short)(u >> 16);
+  }
+  static float decode(const unsigned short h){
+    const unsigned int u = (unsigned int)h << 16;
+    float f;
+    memcpy(&f, &u, sizeof(float));
+    return f;
+  }
+};
+
+/**
+ * IEEE half precision values: 11 bits of precision, normal down to 6.1e-5
+ */
+struct fp16_codec {
+  static const char *name(){ return "float16"; }
+#ifdef __F16C__
+  static unsigned short encode(const float f){ return _cvtss_sh(f, 0); }
+  static float decode(const unsigned short h){ return _cvtsh_ss(h); }
+#else
+  static unsigned short encode(const float f){
+    unsigned int x;
+    memcpy(&x, &f, sizeof(float));
+    const unsigned int sign = (x >> 16) & 0x8000;
+    x &= 0x7FFFFFFF;
+    if (x > 0x7F800000) return sign | 0x7E00; // not a number
+    if (x >= 0x47800000) return sign | 0x7C00; // overflow
+    if (x < 0x38800000){ // subnormal
+      if (x < 0x33000000) return sign;
+      const unsigned int m = (x & 0x7FFFFF) | 0x800000;
+      const int shift = 126 - (x >> 23);
+      unsigned int h = m >> shift;
+      const unsigned int rem = m & ((1u << shift) - 1), half = 1u << (shift - 1);
+      if (rem > half || (rem == half && (h & 1))) h++;
+      return sign | h;
+    }
+    unsigned int h = (x - 0x38000000) >> 13;
+    const unsigned int rem = x & 0x1FFF;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1))) h++; // a carry rounds up the exponent
+    return sign | h;
+  }
+  static float decode(const unsigned short h){
+    const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+    const unsigned int e = (h >> 10) & 0x1F, m = h & 0x3FF;
+    unsigned int u;
+    if (e == 0){
+      const float f = m * 5.9604644775390625e-8f; // 2^-24
+      return (sign) ? -f : f;
+    }
+    if (e == 31) u = sign | 0x7F800000 | (m << 13);
+    else u = sign | ((e + 112) << 23) | (m << 13);
+    float f;
+    memcpy(&f, &u, sizeof(float));
+    return f;
+  }
+#endif
+};
+
+/**
+ * Row-major sparse matrix with 16-bit values and delta-coded column indices
+ */
+template <class Codec>
+class CompactSMatrix {
+public:
+  // empty matrix of nnz entries, filled row by row with appendRow()
+  CompactSMatrix(const long rows, const long cols, const unsigned long long nnz) : rows_(rows), cols_(cols) {
+    reserve(nnz);
+  }
+
+  // from a compressed row-major sparse matrix, owned or mapped
+  template <class SparseMat>
+  CompactSMatrix(const SparseMat& A) : rows_(A.rows()), cols_(A.cols()) {
+    const typename SparseMat::Index *outer = A.outerIndexPtr();
+    const typename SparseMat::Index *inner = A.innerIndexPtr();
+    const float *val = A.valuePtr();
+    reserve(A.nonZeros());
+    for (long i = 0; i < rows_; ++i) appendRow(inner + outer[i], val + outer[i], outer[i+1] - outer[i]);
+  }
+
+  // append the next row, with its column indices in increasing order
+  template <class Index>
+  void appendRow(const Index *inner, const float *val, const long n){
+    long prev = 0;
+    for (long k = 0; k < n; ++k){
+      val_.push_back(Codec::encode(val[k]));
+      const long delta = inner[k] - prev;
+      if (delta < COMPACT_ESCAPE) idx_.push_back((unsigned short)delta);
+      else {
+        idx_.push_back(COMPACT_ESCAPE);
+        idx_.push_back((unsigned short)(inner[k] & 0xFFFF));
+        idx_.push_back((unsigned short)((unsigned long)inner[k] >> 16));
+      }
+      prev = inner[k];
+    }
+    valPtr_.push_back(val_.size());
+    idxPtr_.push_back(idx_.size());
+  }
+
+  long rows() const { return rows_; }
+  long cols() const { return cols_; }
+  unsigned long long nonZeros() const { return val_.size(); }
+
+  // bytes taken by the matrix
+  size_t memory() const {
+    return sizeof(unsigned short)*(val_.size() + idx_.size()) + sizeof(unsigned long long)*(valPtr_.size() + idxPtr_.size());
+  }
+
+  // call f(column, value) on every entry of row i, in column order
+  template <class F>
+  void forEachInRow(const long i, F& f) const {
+    const unsigned short *d = &idx_[0] + idxPtr_[i];
+    unsigned long c = 0;
+    for (unsigned long long k = valPtr_[i]; k < valPtr_[i+1]; ++k){
+      const unsigned int delta = *d++;
+      if (delta == COMPACT_ESCAPE){
+        c = d[0] | ((unsigned long)d[1] << 16);
+        d += 2;
+      } else c += delta;
+      f(c, Codec::decode(val_[k]));
+    }
+  }
+
+private:
+  // room for every entry and an escaped first column in each row
+  void reserve(const unsigned long long nnz){
+    valPtr_.reserve(rows_+1);
+    idxPtr_.reserve(rows_+1);
+    val_.reserve(nnz);
+    idx_.reserve(nnz + 2*rows_);
+    valPtr_.push_back(0);
+    idxPtr_.push_back(0);
+  }
+
+  long rows_;
+  long cols_;
+  std::vector<unsigned long long> valPtr_; // first value of each row
+  std::vector<unsigned long long> idxPtr_; // first index word of each row
+  std::vector<unsigned short> val_;
+  std::vector<unsigned short> idx_;
+};
+
+// accumulate the entries of a row in a row of the result: res += v * rhs.col(c)
+struct CompactGather {
+  float *res;
+  const float *rhs;
+  long n;
+  void operator()(const unsigned long c, const float v) const { axpy(res, v, rhs + c*n, n); }
+};
+
+// scatter the entries of a row into the rows of the result: res.col(c) += v * x
+struct CompactScatter {
+  float *res;
+  const float *x;
+  long n;
+  long ld;
+  void operator()(const unsigned long c, const float v) const { axpy(res + c*ld, v, x, n); }
+};
+
+/**
+ * A * Y, every row of the result is computed from contiguous rows of Y
+ */
+template <class Codec>
+Eigen::MatrixXf multiply(const CompactSMatrix<Codec>& A, const Eigen::MatrixXf& Y){
+  const Eigen::MatrixXf Yt = Y.transpose();
+  Eigen::MatrixXf Bt = Eigen::MatrixXf::Zero(Y.cols(), A.rows());
+  const long n = Y.cols();
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (long i = 0; i < A.rows(); ++i){
+    CompactGather f = { Bt.data() + i*n, Yt.data(), n };
+    A.forEachInRow(i, f);
+  }
+  return Bt.transpose();
+}
+
+/**
+ * A^T * O, threads split the columns of O so that they scatter into disjoint
+ * parts of the rows of the result
+ */
+template <class Codec>
+Eigen::MatrixXf multiplyTranspose(const CompactSMatrix<Codec>& A, const Eigen::MatrixXf& O){
+  const Eigen::MatrixXf Ot = O.transpose();
+  Eigen::MatrixXf Yt = Eigen::MatrixXf::Zero(O.cols(), A.cols());
+  const long n = O.cols();
+  // slices of 8 floats at least, one per thread
+  const long nslice = std::max(1L, std::min((long)Eigen::nbThreads(), n / 8));
+  #pragma omp parallel for schedule(static, 1)
+  for (long s = 0; s < nslice; ++s){
+    const long begin = n * s / nslice, end = n * (s+1) / nslice;
+    for (long i = 0; i < A.rows(); ++i){
+      CompactScatter f = { Yt.data() + begin, Ot.data() + i*n + begin, end - begin, n };
+      A.forEachInRow(i, f);
+    }
+  }
+  return Yt.transpose();
+}
+
+}
+
+#endif // REDSVD_COMPACT_HPP__
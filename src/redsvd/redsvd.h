@@ -30,6 +30,18 @@
 
 namespace REDSVD {
 
+// A * Y, overloaded for other storages of A
+template <class Mat>
+Eigen::MatrixXf multiply(const Mat& A, const Eigen::MatrixXf& Y){
+  return A * Y;
+}
+
+// A^T * O, overloaded for other storages of A
+template <class Mat>
+Eigen::MatrixXf multiplyTranspose(const Mat& A, const Eigen::MatrixXf& O){
+  return A.transpose() * O;
+}
+
 class RedSVD {
 public:
   RedSVD(){}
@@ -56,13 +68,13 @@ public:
     Util::sampleGaussianMat(O);
     
     // Compute Sample Matrix of A^T
-    Eigen::MatrixXf Y = A.transpose() * O;
+    Eigen::MatrixXf Y = multiplyTranspose(A, O);
     
     // Orthonormalize Y
     Util::processGramSchmidt(Y);
 
     // Range(B) = Range(A^T)
-    Eigen::MatrixXf B = A * Y;
+    Eigen::MatrixXf B = multiply(A, Y);
     
     // Gaussian Random Matrix
     Eigen::MatrixXf P(B.cols(), r);
@@ -0,0 +1,135 @@
+// Sparse matrix stored with its transpose for the randomized SVD
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file       transposed.h
+ * @author     Remi Lebret
+ * @brief      row-major sparse matrix with a row-major copy of its transpose
+ *
+ * A^T * O on a row-major matrix scatters every entry into a row of the
+ * result, which threads cannot share. With the transpose stored as well,
+ * every row of A^T * O is gathered from contiguous rows of O^T, rows in
+ * parallel, at the cost of a second copy of the matrix.
+ */
+
+#ifndef REDSVD_TRANSPOSED_HPP__
+#define REDSVD_TRANSPOSED_HPP__
+
+#include <algorithm>
+#include <vector>
+#include "util.h"
+#include "redsvd.h"
+
+namespace REDSVD {
+
+/**
+ * Row-major sparse matrix, owned or mapped, with the transpose of the matrix
+ */
+template <class Mat>
+class TransposedSMatrix {
+public:
+  // the transpose is built by threads in charge of disjoint ranges of columns of A
+  TransposedSMatrix(const Mat& A) : A_(A), At_(A.cols(), A.rows()) {
+    typedef SMatrixXf::Index Index;
+    const typename Mat::Index *outer = A.outerIndexPtr();
+    const typename Mat::Index *inner = A.innerIndexPtr();
+    const float *val = A.valuePtr();
+    const long nrow = A.rows(), ncol = A.cols();
+    At_.resizeNonZeros(A.nonZeros());
+    Index *tOuter = At_.outerIndexPtr();
+    Index *tInner = At_.innerIndexPtr();
+    float *tVal = At_.valuePtr();
+    const long nslice = std::max(1L, std::min((long)Eigen::nbThreads(), ncol));
+
+    // count the entries of each column
+    std::fill(tOuter, tOuter + ncol + 1, 0);
+    #pragma omp parallel for schedule(static, 1)
+    for (long s = 0; s < nslice; ++s){
+      const long begin = ncol * s / nslice, end = ncol * (s+1) / nslice;
+      for (long i = 0; i < nrow; ++i){
+        // columns are sorted within rows
+        const typename Mat::Index *k = std::lower_bound(inner + outer[i], inner + outer[i+1], begin);
+        for (; k < inner + outer[i+1] && *k < end; ++k) tOuter[*k + 1]++;
+      }
+    }
+    for (long c = 0; c < ncol; ++c) tOuter[c+1] += tOuter[c];
+
+    // fill each column with its entries, in row order
+    std::vector<Index> next(tOuter, tOuter + ncol);
+    #pragma omp parallel for schedule(static, 1)
+    for (long s = 0; s < nslice; ++s){
+      const long begin = ncol * s / nslice, end = ncol * (s+1) / nslice;
+      for (long i = 0; i < nrow; ++i){
+        long k = std::lower_bound(inner + outer[i], inner + outer[i+1], begin) - inner;
+        for (; k < outer[i+1] && inner[k] < end; ++k){
+          const Index pos = next[inner[k]]++;
+          tInner[pos] = i;
+          tVal[pos] = val[k];
+        }
+      }
+    }
+  }
+
+  long rows() const { return A_.rows(); }
+  long cols() const { return A_.cols(); }
+  const Mat& matrix() const { return A_; }
+  const SMatrixXf& transposed() const { return At_; }
+
+  // bytes taken by the transpose
+  size_t memory() const {
+    return sizeof(float)*At_.nonZeros() + sizeof(SMatrixXf::Index)*(At_.nonZeros() + At_.rows() + 1);
+  }
+
+private:
+  const Mat& A_;
+  SMatrixXf At_;
+};
+
+/**
+ * A * Y with the products of A
+ */
+template <class Mat>
+Eigen::MatrixXf multiply(const TransposedSMatrix<Mat>& A, const Eigen::MatrixXf& Y){
+  return multiply(A.matrix(), Y);
+}
+
+/**
+ * A^T * O, every row of the result is gathered from contiguous rows of O
+ */
+template <class Mat>
+Eigen::MatrixXf multiplyTranspose(const TransposedSMatrix<Mat>& A, const Eigen::MatrixXf& O){
+  typedef SMatrixXf::Index Index;
+  const SMatrixXf& At = A.transposed();
+  const Index *outer = At.outerIndexPtr();
+  const Index *inner = At.innerIndexPtr();
+  const float *val = At.valuePtr();
+  const Eigen::MatrixXf Ot = O.transpose();
+  Eigen::MatrixXf Yt = Eigen::MatrixXf::Zero(O.cols(), At.rows());
+  const long n = O.cols();
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (long i = 0; i < At.rows(); ++i){
+    float *res = Yt.data() + i*n;
+    for (Index k = outer[i]; k < outer[i+1]; ++k) axpy(res, val[k], Ot.data() + inner[k]*n, n);
+  }
+  return Yt.transpose();
+}
+
+}
+
+#endif // REDSVD_TRANSPOSED_HPP__
@@ -23,15 +23,28 @@
 #define EIGEN_YES_I_KNOW_SPARSE_MODULE_IS_NOT_STABLE_YET
 
 #include <vector>
+#include "../config.h"
 #include "Eigen/Sparse"
 #include "Eigen/Dense"
 #include "Eigen/Eigenvalues"
 
 namespace REDSVD {
 
+// 32-bit indices hold up to 2^31 non-zero entries, with half the memory of 64-bit ones
+#ifdef HPCA_64BIT_INDEX
+typedef Eigen::SparseMatrix<float, Eigen::RowMajor, long> SMatrixXf;
+#else
 typedef Eigen::SparseMatrix<float, Eigen::RowMajor> SMatrixXf;
+#endif
+// sparse matrix over arrays it does not own, e.g. mapped from a file
+typedef Eigen::MappedSparseMatrix<float, Eigen::RowMajor, SMatrixXf::Index> MSMatrixXf;
 typedef std::vector<std::pair<int, float> > fv_t;
 
+// y += v * x over n floats
+inline void axpy(float *y, const float v, const float *x, const long n){
+  for (long j = 0; j < n; ++j) y[j] += v * x[j];
+}
+
 
 class AscentCompareIndicesByAnotherVectorValues{
     Eigen::VectorXf& _values;
@@ -31,7 +31,7 @@
 int get_stats(const char* filename){
 
     char token[MAX_TOKEN];
-    int freq;
+    unsigned long long freq;
     int i_freq=0;
     int nfreq=11;
     int cnt[11]={10000,5000,1000,500,100,50,10,5,4,3,2};
@@ -39,18 +39,18 @@ int get_stats(const char* filename){
     float threshold=1;
     int i=0;
     int vocab_size=0;
-    long int ntoken=0;
+    long long ntoken=0;
 
     // open vocabulary file
     FILE *fp = fopen(filename, "r");
     // get statistics on vocabulary
-    while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
+    while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
         vocab_size++;
         ntoken+=freq;
     }
 
     fprintf(stderr, "number of word types           = %d\n",vocab_size);
-    fprintf(stderr, "total number of tokens in file = %ld\n",ntoken);
+    fprintf(stderr, "total number of tokens in file = %lld\n",ntoken);
     fprintf(stderr, "---------------------------------------\n");
 
     // get back at the beginning of the file
@@ -58,9 +58,9 @@ int get_stats(const char* filename){
 
     float appearance_freq;
     const float ratio = 1.0/ntoken;
-    while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
+    while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
         appearance_freq=freq*ratio;
-        while ( (i_freq<nfreq) && (freq<cnt[i_freq]) ){
+        while ( (i_freq<nfreq) && (freq<(unsigned long long)cnt[i_freq]) ){
           res[i_freq]=i;
           i_freq++;
         }
@@ -54,6 +54,7 @@
 #define MAX_FULLPATH_NAME      300
 #define MAX_TOKEN              100
 #define MAX_TOKEN_PER_LINE     512
+#define MAX_CXT_SIZE           1024
 #define MAX_STRING_LENGTH      2000
 
 #define MAX_HASH_SIZE          30000000  // Maximum 30 * 0.7 = 21M words in the vocabulary
@@ -63,6 +64,13 @@
 
 #define EPSILON 0.001
 
+/* largest gzipped file whose trailer gives its exact size, 4GB over the maximal deflate ratio of 1032:1 */
+#define GZIP_TRAILER_LIMIT 4161790L
+/* uncompressed bytes read to estimate the compression ratio of larger gzipped files */
+#define GZIP_SAMPLE_SIZE 16777216L
+/* end of the last part of a file whose size is only estimated, read up to the end of file */
+#define FILE_END 0x7fffffffffffffffL
+
 /* macros for octet */
 #define KILOOCTET 1024
 #define MEGAOCTET 1048576
@@ -0,0 +1,351 @@
+// Compressed sparse row layout of the cooccurrence matrix
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+#include "csr.h"
+
+// C++ header
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+// C header
+#include <unistd.h>
+
+/* magic number starting every CSR file */
+static const char CSR_MAGIC[8] = {'H','P','C','A','C','S','R','1'};
+static const char CSR_INDEX_MAGIC[8] = {'H','P','C','A','I','D','X','1'};
+
+/* size of the buffers used to copy and read entries */
+#define CSR_BUFFER_SIZE 1048576
+
+/* Read the header of a CSR cooccurrence matrix */
+int csr_read_header(FILE *fin, csr_header_t *h){
+    char magic[sizeof(CSR_MAGIC)];
+    unsigned long long dims[3];
+    if ( fread(magic, 1, sizeof(magic), fin) != sizeof(magic) || memcmp(magic, CSR_MAGIC, sizeof(magic)) != 0 ){
+        fseek(fin, 0, SEEK_SET);
+        return 0;
+    }
+    if ( fread(dims, sizeof(unsigned long long), 3, fin) != 3 ){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    h->rows = dims[0];
+    h->cols = dims[1];
+    h->nnz = dims[2];
+    return 1;
+}
+
+/* open a temporary file of entries */
+static FILE *open_entries(const char *filename, const char *mode){
+    FILE *fp = fopen(filename, mode);
+    if (fp == NULL){
+        throw std::runtime_error("Unable to open file " + std::string(filename) + "!");
+    }
+    setvbuf(fp, NULL, _IOFBF, CSR_BUFFER_SIZE);
+    return fp;
+}
+
+/* Create a new CSR cooccurrence matrix */
+csr_writer_t *csr_open_writer(const char *filename, const float min_count, const unsigned int top_k, const unsigned long long memory, const unsigned long long cols){
+    csr_writer_t *cw = (csr_writer_t*)calloc(1, sizeof(csr_writer_t));
+    const size_t len = strlen(filename);
+    cw->file_name = strdup(filename);
+    cw->col_file_name = (char*)malloc(len+5);
+    cw->val_file_name = (char*)malloc(len+5);
+    sprintf(cw->col_file_name, "%s.col", filename);
+    sprintf(cw->val_file_name, "%s.val", filename);
+    // entries are kept in memory until they exceed the given amount
+    cw->mem_limit = memory / (sizeof(unsigned int)+sizeof(float));
+    cw->capacity = 1024;
+    cw->row_ptr = (unsigned long long*)malloc(sizeof(unsigned long long)*(cw->capacity+1));
+    cw->row_id = (unsigned int*)malloc(sizeof(unsigned int)*cw->capacity);
+    cw->rowsum = (double*)malloc(sizeof(double)*cw->capacity);
+    cw->min_count = min_count;
+    cw->top_k = top_k;
+    // the width does not depend on the entries kept by the truncation
+    cw->header.cols = cols;
+    return cw;
+}
+
+/* write out an entry, in memory or in the temporary files */
+static inline void write_entry(csr_writer_t *cw, const unsigned int col, const float val){
+    if (cw->fcol == NULL){
+        if (cw->mem_length < cw->mem_limit){
+            if (cw->mem_length == cw->mem_capacity){
+                cw->mem_capacity = (cw->mem_capacity > 0) ? 2*cw->mem_capacity : 65536;
+                if (cw->mem_capacity > cw->mem_limit) cw->mem_capacity = cw->mem_limit;
+                cw->mem_col = (unsigned int*)realloc(cw->mem_col, sizeof(unsigned int)*cw->mem_capacity);
+                cw->mem_val = (float*)realloc(cw->mem_val, sizeof(float)*cw->mem_capacity);
+            }
+            cw->mem_col[cw->mem_length] = col;
+            cw->mem_val[cw->mem_length++] = val;
+            return;
+        }
+        // too many entries, move them to temporary files
+        cw->fcol = open_entries(cw->col_file_name, "w+b");
+        cw->fval = open_entries(cw->val_file_name, "w+b");
+        fwrite(cw->mem_col, sizeof(unsigned int), cw->mem_length, cw->fcol);
+        fwrite(cw->mem_val, sizeof(float), cw->mem_length, cw->fval);
+        free(cw->mem_col);
+        free(cw->mem_val);
+        cw->mem_col = NULL;
+        cw->mem_val = NULL;
+        cw->mem_length = 0;
+    }
+    fwrite(&col, sizeof(unsigned int), 1, cw->fcol);
+    fwrite(&val, sizeof(float), 1, cw->fval);
+}
+
+/* larger entries first, then by column, signed entries are compared by magnitude */
+static bool greater_entry(const cooccur_t &a, const cooccur_t &b){
+    const float va = fabsf(a.val), vb = fabsf(b.val);
+    return (va > vb) || (va == vb && a.idx2 < b.idx2);
+}
+
+/* write out the entries of the pending row kept by the truncation */
+static void flush_row(csr_writer_t *cw){
+    csr_header_t *h = &cw->header;
+    cooccur_t *row = cw->row;
+    unsigned long long n = 0;
+    for (unsigned long long k=0; k<cw->row_length; k++){
+        if (fabsf(row[k].val) >= cw->min_count) row[n++] = row[k];
+    }
+    if (cw->top_k > 0 && n > cw->top_k){
+        std::nth_element(row, row+cw->top_k, row+n, greater_entry);
+        n = cw->top_k;
+        std::sort(row, row+n, less_cooccur);
+    }
+    for (unsigned long long k=0; k<n; k++){
+        write_entry(cw, row[k].idx2, row[k].val);
+        if (row[k].idx2 >= h->cols) h->cols = row[k].idx2+1;
+    }
+    h->nnz += n;
+    cw->row_length = 0;
+}
+
+/* start a new row */
+static void start_row(csr_writer_t *cw, const unsigned int id){
+    csr_header_t *h = &cw->header;
+    if (cw->min_count > 0 || cw->top_k > 0) flush_row(cw);
+    if (h->rows == cw->capacity){
+        cw->capacity *= 2;
+        cw->row_ptr = (unsigned long long*)realloc(cw->row_ptr, sizeof(unsigned long long)*(cw->capacity+1));
+        cw->row_id = (unsigned int*)realloc(cw->row_id, sizeof(unsigned int)*cw->capacity);
+        cw->rowsum = (double*)realloc(cw->rowsum, sizeof(double)*cw->capacity);
+    }
+    cw->row_ptr[h->rows] = h->nnz;
+    cw->row_id[h->rows] = id;
+    cw->rowsum[h->rows] = 0;
+    h->rows++;
+}
+
+/* Append a record */
+int csr_append(csr_writer_t *cw, const cooccur_t *cr){
+    csr_header_t *h = &cw->header;
+    const int truncate = (cw->min_count > 0 || cw->top_k > 0);
+    if (h->rows == 0 || cr->idx1 != cw->row_id[h->rows-1]) start_row(cw, cr->idx1);
+    cw->rowsum[h->rows-1] += fabsf(cr->val); // entries may be signed by context hashing
+    if (truncate){ // rows are written once complete
+        if (cw->row_length == cw->row_capacity){
+            cw->row_capacity = (cw->row_capacity > 0) ? 2*cw->row_capacity : 1024;
+            cw->row = (cooccur_t*)realloc(cw->row, sizeof(cooccur_t)*cw->row_capacity);
+        }
+        cw->row[cw->row_length++] = *cr;
+        return 0;
+    }
+    write_entry(cw, cr->idx2, cr->val);
+    if (cr->idx2 >= h->cols) h->cols = cr->idx2+1;
+    h->nnz++;
+    return 0;
+}
+
+/* Append a whole row with a known sum */
+int csr_append_row(csr_writer_t *cw, const unsigned int id, const double rowsum, const cooccur_t *entries, const unsigned long long length){
+    start_row(cw, id);
+    for (unsigned long long k=0; k<length; k++) csr_append(cw, &entries[k]);
+    cw->rowsum[cw->header.rows-1] = rowsum;
+    return 0;
+}
+
+/* append a temporary file of entries to the output */
+static void copy_entries(FILE *from, FILE *to, char *buffer){
+    fflush(from);
+    fseek(from, 0, SEEK_SET);
+    size_t n;
+    while ( (n = fread(buffer, 1, CSR_BUFFER_SIZE, from)) > 0 ){
+        if (fwrite(buffer, 1, n, to) != n){
+            throw std::runtime_error("error while writing cooccurrence file on disk!!");
+        }
+    }
+}
+
+/* Assemble and close a CSR cooccurrence matrix */
+unsigned long long csr_close_writer(csr_writer_t *cw){
+    csr_header_t *h = &cw->header;
+    if (cw->row_length > 0) flush_row(cw);
+    cw->row_ptr[h->rows] = h->nnz;
+    FILE *fout = fopen(cw->file_name, "wb");
+    if (fout == NULL){
+        throw std::runtime_error("Unable to open file " + std::string(cw->file_name) + "!");
+    }
+    const unsigned long long dims[3] = {h->rows, h->cols, h->nnz};
+    fwrite(CSR_MAGIC, 1, sizeof(CSR_MAGIC), fout);
+    fwrite(dims, sizeof(unsigned long long), 3, fout);
+    fwrite(cw->row_ptr, sizeof(unsigned long long), h->rows+1, fout);
+    fwrite(cw->row_id, sizeof(unsigned int), h->rows, fout);
+    // row sums are narrowed to floats only now
+    float *rowsum = (float*)malloc(sizeof(float)*(h->rows+1));
+    for (unsigned long long r=0; r<h->rows; r++) rowsum[r] = (float)cw->rowsum[r];
+    fwrite(rowsum, sizeof(float), h->rows, fout);
+    free(rowsum);
+    if (cw->fcol){
+        char *buffer = (char*)malloc(CSR_BUFFER_SIZE);
+        copy_entries(cw->fcol, fout, buffer);
+        copy_entries(cw->fval, fout, buffer);
+        free(buffer);
+        // remove temporary files
+        fclose(cw->fcol);
+        fclose(cw->fval);
+        remove(cw->col_file_name);
+        remove(cw->val_file_name);
+    }else if ( fwrite(cw->mem_col, sizeof(unsigned int), cw->mem_length, fout) != cw->mem_length
+            || fwrite(cw->mem_val, sizeof(float), cw->mem_length, fout) != cw->mem_length ){
+        throw std::runtime_error("error while writing cooccurrence file on disk!!");
+    }
+    fclose(fout);
+    const unsigned long long nnz = h->nnz;
+    // release memory
+    if (cw->mem_col) free(cw->mem_col);
+    if (cw->mem_val) free(cw->mem_val);
+    free(cw->row_ptr);
+    free(cw->row_id);
+    free(cw->rowsum);
+    if (cw->row) free(cw->row);
+    free(cw->file_name);
+    free(cw->col_file_name);
+    free(cw->val_file_name);
+    free(cw);
+    return nnz;
+}
+
+/* Open a CSR cooccurrence matrix to read back its records */
+csr_reader_t *csr_open_reader(const char *filename){
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL) return NULL;
+    csr_reader_t *cr = (csr_reader_t*)calloc(1, sizeof(csr_reader_t));
+    csr_header_t *h = &cr->header;
+    if (!csr_read_header(fin, h)){
+        fclose(fin);
+        free(cr);
+        throw std::runtime_error("file " + std::string(filename) + " is not a CSR cooccurrence file!!");
+    }
+    // rows are small enough to be kept in memory
+    cr->row_ptr = (unsigned long long*)malloc(sizeof(unsigned long long)*(h->rows+1));
+    cr->row_id = (unsigned int*)malloc(sizeof(unsigned int)*(h->rows+1));
+    if ( fread(cr->row_ptr, sizeof(unsigned long long), h->rows+1, fin) != h->rows+1
+      || fread(cr->row_id, sizeof(unsigned int), h->rows, fin) != h->rows ){
+        throw std::runtime_error("truncated cooccurrence file " + std::string(filename) + "!!");
+    }
+    // one stream per entry array
+    cr->fcol = fin;
+    setvbuf(cr->fcol, NULL, _IOFBF, CSR_BUFFER_SIZE);
+    fseek(cr->fcol, csr_col_offset(h), SEEK_SET);
+    cr->fval = open_entries(filename, "rb");
+    fseek(cr->fval, csr_val_offset(h), SEEK_SET);
+    return cr;
+}
+
+/* Read next record */
+int csr_read(csr_reader_t *cr, cooccur_t *rec){
+    if (cr->pos >= cr->header.nnz) return 0;
+    while (cr->pos >= cr->row_ptr[cr->row+1]) cr->row++;
+    if ( fread(&rec->idx2, sizeof(unsigned int), 1, cr->fcol) != 1
+      || fread(&rec->val, sizeof(float), 1, cr->fval) != 1 ){
+        throw std::runtime_error("truncated cooccurrence file!!");
+    }
+    rec->idx1 = cr->row_id[cr->row];
+    cr->pos++;
+    return 1;
+}
+
+/* Close a CSR reader */
+void csr_close_reader(csr_reader_t *cr){
+    fclose(cr->fcol);
+    fclose(cr->fval);
+    free(cr->row_ptr);
+    free(cr->row_id);
+    free(cr);
+}
+
+/* Read the header of the index of a CSR cooccurrence matrix */
+int csr_read_index_header(int fd, unsigned long long *n, unsigned long long *nnz){
+    char header[CSR_INDEX_HEADER_SIZE];
+    if ( pread(fd, header, CSR_INDEX_HEADER_SIZE, 0) != CSR_INDEX_HEADER_SIZE
+      || memcmp(header, CSR_INDEX_MAGIC, sizeof(CSR_INDEX_MAGIC)) != 0 ){
+        return 0;
+    }
+    memcpy(n, header+sizeof(CSR_INDEX_MAGIC), sizeof(unsigned long long));
+    memcpy(nnz, header+sizeof(CSR_INDEX_MAGIC)+sizeof(unsigned long long), sizeof(unsigned long long));
+    return 1;
+}
+
+/* Write the index of a CSR cooccurrence matrix */
+void csr_write_index(const char *filename, const char *index_file_name){
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL){
+        throw std::runtime_error("Unable to open file " + std::string(filename) + "!");
+    }
+    csr_header_t h;
+    if (!csr_read_header(fin, &h)){
+        fclose(fin);
+        throw std::runtime_error("file " + std::string(filename) + " is not a CSR cooccurrence file!!");
+    }
+    unsigned long long *row_ptr = (unsigned long long*)malloc(sizeof(unsigned long long)*(h.rows+1));
+    unsigned int *row_id = (unsigned int*)malloc(sizeof(unsigned int)*(h.rows+1));
+    if ( fread(row_ptr, sizeof(unsigned long long), h.rows+1, fin) != h.rows+1
+      || fread(row_id, sizeof(unsigned int), h.rows, fin) != h.rows ){
+        throw std::runtime_error("truncated cooccurrence file " + std::string(filename) + "!!");
+    }
+    fclose(fin);
+    // one entry per target id, rows are sorted by id
+    const unsigned long long n = (h.rows > 0) ? (unsigned long long)row_id[h.rows-1]+1 : 0;
+    csr_index_entry_t *entries = (csr_index_entry_t*)calloc(n > 0 ? n : 1, sizeof(csr_index_entry_t));
+    const unsigned long long col_offset = csr_col_offset(&h);
+    for (unsigned long long r=0; r<h.rows; r++){
+        entries[row_id[r]].offset = col_offset + sizeof(unsigned int)*row_ptr[r];
+        entries[row_id[r]].length = row_ptr[r+1] - row_ptr[r];
+    }
+    FILE *fout = fopen(index_file_name, "wb");
+    if (fout == NULL){
+        throw std::runtime_error("Unable to open file " + std::string(index_file_name) + "!");
+    }
+    const unsigned long long dims[2] = {n, h.nnz};
+    fwrite(CSR_INDEX_MAGIC, 1, sizeof(CSR_INDEX_MAGIC), fout);
+    fwrite(dims, sizeof(unsigned long long), 2, fout);
+    if (fwrite(entries, sizeof(csr_index_entry_t), n, fout) != n){
+        throw std::runtime_error("error while writing index file on disk!!");
+    }
+    fclose(fout);
+    free(entries);
+    free(row_ptr);
+    free(row_id);
+}
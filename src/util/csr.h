@@ -0,0 +1,240 @@
+// Compressed sparse row layout of the cooccurrence matrix
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file       csr.h
+ * @author     Remi Lebret
+ * @brief      compressed sparse row layout of cooccurrence.bin
+ *
+ * The file starts with the magic number @c HPCACSR1 followed by the
+ * number of rows, columns and non-zero entries (64-bit integers), then:
+ * - row pointers: rows+1 64-bit offsets into the entry arrays,
+ * - row ids: rows 32-bit target word ids in the vocabulary (or in the target file),
+ * - row sums: rows floats, sums of absolute values when entries are signed,
+ * - column indices: nnz 32-bit integers,
+ * - values: nnz floats.
+ * Rows are stored in increasing target id order, i.e. in the order of
+ * @c target_words.txt, and columns are sorted within each row.
+ *
+ * The sidecar index starts with the magic number @c HPCAIDX1 followed by
+ * the number of entries and the number of non-zero entries of the matrix
+ * (64-bit integers), then one csr_index_entry_t per target id in the
+ * vocabulary. Values of a row are found @c 4*nnz bytes after its column
+ * indices.
+ */
+
+#ifndef CSR_H_
+#define CSR_H_
+
+// C header
+#include <stdio.h>
+
+#include "data.h"
+
+/**
+ * 	@ingroup Utility
+ * 	@{
+ */
+
+/* size of the header in bytes */
+#define CSR_HEADER_SIZE 32
+#define CSR_INDEX_HEADER_SIZE 24
+
+/**
+ * 	@struct csr_header_t
+ *
+ *	@brief dimensions of a CSR cooccurrence matrix
+ */
+struct csr_header {
+    unsigned long long rows;
+    unsigned long long cols;
+    unsigned long long nnz;
+};
+typedef csr_header csr_header_t;
+
+/* byte offsets of the arrays */
+inline unsigned long long csr_row_ptr_offset(){ return CSR_HEADER_SIZE; }
+inline unsigned long long csr_row_id_offset(const csr_header_t *h){ return csr_row_ptr_offset() + sizeof(unsigned long long)*(h->rows+1); }
+inline unsigned long long csr_rowsum_offset(const csr_header_t *h){ return csr_row_id_offset(h) + sizeof(unsigned int)*h->rows; }
+inline unsigned long long csr_col_offset(const csr_header_t *h){ return csr_rowsum_offset(h) + sizeof(float)*h->rows; }
+inline unsigned long long csr_val_offset(const csr_header_t *h){ return csr_col_offset(h) + sizeof(unsigned int)*h->nnz; }
+
+/**
+ * 	@struct csr_index_entry_t
+ *
+ *	@brief location of a row in a CSR cooccurrence matrix
+ */
+struct csr_index_entry {
+    unsigned long long offset; // byte offset of the first column index, 0 if no row
+    unsigned long long length; // number of non-zero entries
+};
+typedef csr_index_entry csr_index_entry_t;
+
+/**
+ * 	@struct csr_writer_t
+ *
+ *	@brief writer of a CSR cooccurrence matrix from sorted records
+ */
+struct csr_writer {
+    char *file_name;
+    char *col_file_name;
+    char *val_file_name;
+    FILE *fcol;
+    FILE *fval;
+    unsigned long long *row_ptr;
+    unsigned int *row_id;
+    double *rowsum; // accumulated in double, written as floats
+    unsigned long long capacity;
+    csr_header_t header;
+    // truncation of rows, applied once their sum is known
+    float min_count;
+    unsigned int top_k;
+    cooccur_t *row;
+    unsigned long long row_length;
+    unsigned long long row_capacity;
+    // entries kept in memory while they fit
+    unsigned int *mem_col;
+    float *mem_val;
+    unsigned long long mem_length;
+    unsigned long long mem_capacity;
+    unsigned long long mem_limit;
+};
+typedef csr_writer csr_writer_t;
+
+/**
+ * 	@struct csr_reader_t
+ *
+ *	@brief sequential reader of the records of a CSR cooccurrence matrix
+ */
+struct csr_reader {
+    FILE *fcol;
+    FILE *fval;
+    unsigned long long *row_ptr;
+    unsigned int *row_id;
+    unsigned long long row;
+    unsigned long long pos;
+    csr_header_t header;
+};
+typedef csr_reader csr_reader_t;
+
+/**
+ * @brief Read the header of a CSR cooccurrence matrix
+ *
+ * @param fin the file stream, positioned at the beginning of the file
+ * @param h where to store the dimensions
+ * @return 1 for a CSR file, 0 for a flat file of @c cooccur_t records
+ *         (the stream is then rewound)
+ **/
+int csr_read_header(FILE *fin, csr_header_t *h);
+
+/**
+ * @brief Create a new CSR cooccurrence matrix
+ *
+ * Entries are kept in memory up to @p memory bytes, then written to
+ * temporary files next to @p filename, and the file is assembled when
+ * the writer is closed.
+ * Row sums always include every entry of a row, even those
+ * dropped by @p min_count or @p top_k, and the matrix keeps
+ * at least @p cols columns, even if truncation empties the last ones.
+ *
+ * @param filename the file name
+ * @param min_count drop entries lower than this value, 0 to keep them all
+ * @param top_k keep only the k largest entries of each row, 0 to keep them all
+ * @param memory amount of memory for entries, in bytes
+ * @param cols number of columns of the matrix, e.g. the size of the context vocabulary,
+ *        0 for one column past the largest column index written
+ * @return the writer
+ **/
+csr_writer_t *csr_open_writer(const char *filename, const float min_count=0, const unsigned int top_k=0, const unsigned long long memory=0, const unsigned long long cols=0);
+
+/**
+ * @brief Append a record, records must come in increasing (idx1, idx2) order
+ *
+ * @param cw the writer
+ * @param cr the record
+ **/
+int csr_append(csr_writer_t *cw, const cooccur_t *cr);
+
+/**
+ * @brief Append a whole row with a known sum, when some of its entries are not counted
+ *
+ * @param cw the writer
+ * @param id the target word id of the row, larger than the ids of the previous rows
+ * @param rowsum the sum of the row
+ * @param entries the records of the row, in increasing @c idx2 order
+ * @param length the number of records
+ **/
+int csr_append_row(csr_writer_t *cw, const unsigned int id, const double rowsum, const cooccur_t *entries, const unsigned long long length);
+
+/**
+ * @brief Assemble and close a CSR cooccurrence matrix
+ *
+ * @param cw the writer
+ * @return the number of entries kept in the matrix
+ **/
+unsigned long long csr_close_writer(csr_writer_t *cw);
+
+/**
+ * @brief Open a CSR cooccurrence matrix to read back its records
+ *
+ * @param filename the file name
+ * @return the reader, NULL if the file cannot be opened
+ **/
+csr_reader_t *csr_open_reader(const char *filename);
+
+/**
+ * @brief Read next record, with @c idx1 set to the target word id
+ *
+ * @param cr the reader
+ * @param rec where to store the record
+ * @return 1 if a record has been read, 0 at the end of the matrix
+ **/
+int csr_read(csr_reader_t *cr, cooccur_t *rec);
+
+/**
+ * @brief Close a CSR reader
+ *
+ * @param cr the reader
+ **/
+void csr_close_reader(csr_reader_t *cr);
+
+/**
+ * @brief Read the header of the index of a CSR cooccurrence matrix
+ *
+ * @param fd the file descriptor
+ * @param n where to store the number of entries
+ * @param nnz where to store the number of non-zero entries of the matrix
+ * @return 1 for an index file, 0 otherwise
+ **/
+int csr_read_index_header(int fd, unsigned long long *n, unsigned long long *nnz);
+
+/**
+ * @brief Write the index of a CSR cooccurrence matrix
+ *
+ * Map every target id up to the largest one of the matrix to the byte
+ * offset and the length of its row, with empty rows for words not found.
+ *
+ * @param filename the CSR file name
+ * @param index_file_name the index file name
+ **/
+void csr_write_index(const char *filename, const char *index_file_name);
+
+/** @} */
+
+#endif /* CSR_H_ */
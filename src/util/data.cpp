@@ -43,18 +43,17 @@ int write(cooccur_t *cr, unsigned long long length, FILE *fout) {
 
 /* Check if two cooccurrence records are for the same two words, used for qsort */
 int compare(const void *a, const void *b) {
-    int c;
-    if( (c = ((cooccur_t *) a)->idx1 - ((cooccur_t *) b)->idx1) != 0) return c;
-    else return (((cooccur_t *) a)->idx2 - ((cooccur_t *) b)->idx2);
-    
+    const cooccur_t *ca = (cooccur_t *) a, *cb = (cooccur_t *) b;
+    // ids are unsigned, a difference would overflow an int
+    if (ca->idx1 != cb->idx1) return (ca->idx1 < cb->idx1) ? -1 : 1;
+    return (ca->idx2 > cb->idx2) - (ca->idx2 < cb->idx2);
 }
 
 
 /* Check if two cooccurrence records are for the same two words */
 int compare_id(cooccur_id_t a, cooccur_id_t b) {
-    int c;
-    if( (c = a.idx1 - b.idx1) != 0) return c;
-    else return a.idx2 - b.idx2;
+    if (a.idx1 != b.idx1) return (a.idx1 < b.idx1) ? -1 : 1;
+    return (a.idx2 > b.idx2) - (a.idx2 < b.idx2);
 }
 
 /* Swap two entries of priority queue */
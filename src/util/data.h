@@ -92,6 +92,18 @@ int write(cooccur_t *cr, unsigned long long length, FILE *fout);
  **/
 int compare(const void *a, const void *b);
 
+/**
+ * @brief Order cooccurrence records by first then second token index, used for std::sort
+ *
+ * Unlike qsort, std::sort does not allocate a temporary copy of the records.
+ *
+ * @param a the first record
+ * @param b the second record
+ **/
+inline bool less_cooccur(const cooccur_t &a, const cooccur_t &b){
+    return (a.idx1 < b.idx1) || (a.idx1 == b.idx1 && a.idx2 < b.idx2);
+}
+
 /**
  * @brief Check if two cooccurrence records are for the same two words
  *
@@ -28,6 +28,7 @@
 #include <string>
 #include <cstring>
 #include <cstdlib>
+#include <cmath>
 #include <fstream>
 
 /** Destructor */
@@ -85,12 +86,22 @@ long int File::size()
             throw std::runtime_error(error_msg);
         }
         if (gzip()){
+            fseek(fin, 0, SEEK_END);
+            const long int zsize = ftell(fin);
             fseek(fin, -4, SEEK_END);
-            int b4 = fgetc(fin);
-            int b3 = fgetc(fin);
-            int b2 = fgetc(fin);
-            int b1 = fgetc(fin);
-            fsize = (b1 << 24) | (b2 << 16) + (b3 << 8) + b4;
+            unsigned char b[4];
+            if (fread(b, 1, 4, fin) == 4)
+                fsize = (long int)b[0] | ((long int)b[1] << 8) | ((long int)b[2] << 16) | ((long int)b[3] << 24);
+            // the trailer holds the uncompressed size of the last member modulo 2^32,
+            // the size is only used to split the file and the last part is read up to the end
+            fexact = false;
+            if (zsize >= GZIP_TRAILER_LIMIT){
+                // beyond 4GB at the maximal deflate ratio, count the wraps of the trailer
+                // from the compression ratio of the first bytes
+                const double estimate = zsize * gzip_ratio();
+                const long int wraps = (long int)floor((estimate - fsize) / 4294967296.0 + 0.5);
+                if (wraps > 0) fsize += wraps << 32;
+            }
         }else{
             fseek(fin, 0, SEEK_END);
             fsize=ftell(fin);
@@ -107,6 +118,34 @@ long int File::size()
 }
 
 
+/** Return the compression ratio of the first bytes of a gzipped file
+ **/
+double File::gzip_ratio()
+{
+    gzFile gz = gzopen(file_name.c_str(), "rb");
+    if (gz == NULL){
+        std::string error_msg = std::string("Data file ")
+        + file_name
+        + std::string(" opening error !!!\n");
+        throw std::runtime_error(error_msg);
+    }
+    char *buffer = (char*)malloc(1 << 20);
+    long int size = 0;
+    int n;
+    while (size < GZIP_SAMPLE_SIZE && (n = gzread(gz, buffer, 1 << 20)) > 0) size += n;
+    const long int zsize = gzoffset(gz);
+    free(buffer);
+    gzclose(gz);
+    return (zsize > 0) ? (double)size / zsize : 1.0;
+}
+
+/** Say whether the end of file has been reached
+ **/
+bool File::eof()
+{
+    return (zip) ? gzeof(gzos) : feof(os);
+}
+
 /** file opening
  **/
 void File::open( std::string mode )
@@ -210,12 +249,14 @@ void File::skip_header()
 
 /** split file into n parts
  **/
-void File::split(const int npart){
-    const long int sp = fsize/npart;
+void File::split(const int npart, const long int start, const long int end){
+    const long int last = (end<0 || end==FILE_END) ? size() : end;
+    const long int sp = (last>start) ? (last-start)/npart : 0;
     // allocation
+    if (flines) free(flines);
     flines = (long int*)malloc(sizeof(long int)*(npart+1));
-    flines[0] = 0; // set start
-    flines[npart]=fsize; // set end
+    flines[0] = start; // set start
+    flines[npart] = (end<0 && fexact) ? last : ((end<0) ? FILE_END : end); // set end
     char *line = NULL;
     if (npart>1){
         // open file
@@ -223,14 +264,14 @@ void File::split(const int npart){
         // get the split
         if ( zip ){
             for(int i=1;i<npart; i++){
-                gzseek(gzos, i*sp, SEEK_SET);
+                gzseek(gzos, start+i*sp, SEEK_SET);
                 line = get_next_gzline(gzos);
                 free(line);
                 flines[i] = gztell(gzos);
             }
         }else{
             for(int i=1;i<npart; i++){
-                fseek(os, i*sp, SEEK_SET);
+                fseek(os, start+i*sp, SEEK_SET);
                 line = get_next_line(os);
                 free(line);
                 flines[i] = ftell(os);
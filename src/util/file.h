@@ -52,6 +52,8 @@ class File
     std::string file_name;
     /**< file byte size */
     long int fsize;
+    /**< false when the byte size is estimated (gzipped file) */
+    bool fexact;
     /**< pointer to lines */
     long int * flines;
     /**< file stream */
@@ -73,7 +75,7 @@ class File
         , bool const compression=false
         )
         : file_name(name)
-        , fsize(0), flines(NULL)
+        , fsize(0), fexact(true), flines(NULL)
         , os(0), gzos(0)
         , zip(compression)
     {}
@@ -113,10 +115,29 @@ class File
     /**
      *  @brief Return file byte size ?
      *
+     *  The byte size of a gzipped file is estimated from its trailer, which
+     *  holds the uncompressed size modulo 2^32, and @c fexact is set to false.
+     *  Beyond GZIP_TRAILER_LIMIT, the wraps of the trailer are counted from
+     *  the compression ratio of the first bytes.
+     *
      *  @return the byte size
      */
     long int size();
 
+    /**
+     *  @brief Return the compression ratio of the first bytes of a gzipped file
+     *
+     *  @return the number of uncompressed bytes per compressed byte
+     */
+    double gzip_ratio();
+
+    /**
+     *  @brief Say whether the end of file has been reached
+     *
+     *  @return boolean - true at the end of file, false otherwise.
+     */
+    bool eof();
+
     /**
      * 	@brief Skip the header
      */
@@ -126,8 +147,13 @@ class File
       * @brief Split file into n parts
       *
       * @param npart number of parts
+      * @param start first byte of the part of the file to split
+      * @param end last byte (excluded) of the part of the file to split, -1 for the end of file
+      *
+      * When the byte size is only estimated, the last part ends at FILE_END
+      * and is read up to the end of file.
      **/
-    void split(const int npart);
+    void split(const int npart, const long int start=0, const long int end=-1);
     
     /**
      * 	@brief Count the number of lines into the file
@@ -194,7 +220,7 @@ class File
      *  @brief Return next word in stream
      *
      *  @param word where to store next word
-     *  @return 0 if end of line, 1 otherwise
+     *  @return 0 if end of line or end of file, 1 otherwise
      */
     int getword(char * word);
 
@@ -25,7 +25,8 @@
 
 /* Used in ht_sort for sorting by value */
 int hash_compare(const void *a, const void *b) {
-    return ((entry_t *)b)->value - ((entry_t *)a)->value;
+    const unsigned long long va = ((entry_t *)a)->value, vb = ((entry_t *)b)->value;
+    return (va < vb) - (va > vb);
 }
 
 /* Sorts hashtable by values (descending order) */
@@ -57,6 +58,6 @@ void hash_print(const vocab *hash, const char *filename){
     throw std::runtime_error(error_msg);
   }
   for (vocab::iterator it=hash->begin(); it!=hash->end(); ++it)
-    fprintf(fout, "%s %d\n", it->first.c_str(), it->second);
+    fprintf(fout, "%s %llu\n", it->first.c_str(), it->second);
   fclose(fout);
 }
@@ -28,7 +28,8 @@
 
 #include "sparsepp.h"
 using spp::sparse_hash_map;
-typedef sparse_hash_map<std::string,unsigned int> vocab;
+typedef sparse_hash_map<std::string,unsigned long long> vocab;
+typedef sparse_hash_map<std::string,unsigned int> vocab_ids; // token -> dense id
 
 
 /**
@@ -41,11 +42,11 @@ typedef sparse_hash_map<std::string,unsigned int> vocab;
  *  @var key
  *  a key (a string of characters)
  *  @var value
- *  a value (integer)
+ *  a value (64-bit integer, counts may exceed 2^32 on large corpora)
  */
 struct entry_s {
 	const char *key;
-	unsigned int value;
+	unsigned long long value;
 };
 
 typedef struct entry_s entry_t;
@@ -0,0 +1,458 @@
+// Compressed spill runs of cooccurrence records
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+#include "spill.h"
+#include "constants.h"
+
+// C++ header
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <zlib.h>
+#include <fcntl.h>
+
+/* magic number starting every spill run */
+static const char SPILL_MAGIC[8] = {'H','P','C','A','S','P','L','1'};
+
+/* maximum number of bytes needed to encode one record */
+#define SPILL_MAX_RECORD 24
+
+/* encode an unsigned integer as a varint */
+static inline unsigned char *put_varint(unsigned char *p, unsigned long long v){
+    while (v>=0x80){
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+/* decode a varint */
+static inline const unsigned char *get_varint(const unsigned char *p, unsigned long long *v){
+    unsigned long long r = 0;
+    int shift = 0;
+    while (*p & 0x80){
+        r |= (unsigned long long)(*p++ & 0x7f) << shift;
+        shift += 7;
+    }
+    r |= (unsigned long long)(*p++) << shift;
+    *v = r;
+    return p;
+}
+
+/* write the current block on disk */
+static void spill_flush(spill_writer_t *sw){
+    if (sw->len == 0) return;
+    unsigned int header[2];
+    header[0] = (unsigned int)sw->len;
+    const unsigned char *out = sw->buf;
+    uLongf zlen = sw->len;
+    if (sw->codec == SPILL_CODEC_DEFLATE){
+        zlen = sw->zcap;
+        if (compress2(sw->zbuf, &zlen, sw->buf, sw->len, Z_BEST_SPEED) == Z_OK && zlen < sw->len){
+            out = sw->zbuf;
+        }else{
+            zlen = sw->len; // not worth compressing, store raw bytes
+        }
+    }
+    header[1] = (unsigned int)zlen;
+    if ( fwrite(header, sizeof(unsigned int), 2, sw->fout) != 2 || fwrite(out, 1, zlen, sw->fout) != zlen ){
+        throw std::runtime_error("error while writing spill run on disk!!");
+    }
+    sw->nbytes += sizeof(header) + zlen;
+    // every block is decoded independently
+    sw->len = 0;
+    sw->last1 = 0;
+    sw->last2 = 0;
+}
+
+/* Create a new spill run */
+spill_writer_t *spill_open_writer(const char *filename, const int integer, const int codec){
+    FILE *fout = fopen(filename, "wb");
+    if (fout == NULL){
+        throw std::runtime_error("Unable to open file " + std::string(filename) + "!");
+    }
+    spill_writer_t *sw = (spill_writer_t*)calloc(1, sizeof(spill_writer_t));
+    sw->fout = fout;
+    sw->integer = integer;
+    sw->codec = codec;
+    sw->buf = (unsigned char*)malloc(SPILL_BLOCK_SIZE);
+    if (codec == SPILL_CODEC_DEFLATE){
+        sw->zcap = compressBound(SPILL_BLOCK_SIZE);
+        sw->zbuf = (unsigned char*)malloc(sw->zcap);
+    }
+    // write header
+    const unsigned char flags[2] = {(unsigned char)integer, (unsigned char)codec};
+    fwrite(SPILL_MAGIC, 1, sizeof(SPILL_MAGIC), fout);
+    fwrite(flags, 1, sizeof(flags), fout);
+    sw->nbytes = sizeof(SPILL_MAGIC) + sizeof(flags);
+    return sw;
+}
+
+/* Append a single record to the run */
+int spill_append(spill_writer_t *sw, const cooccur_t *cr){
+    if (sw->len + SPILL_MAX_RECORD > SPILL_BLOCK_SIZE) spill_flush(sw);
+    unsigned char *p = sw->buf + sw->len;
+    p = put_varint(p, cr->idx1 - sw->last1);
+    p = put_varint(p, (cr->idx1 == sw->last1) ? cr->idx2 - sw->last2 : cr->idx2);
+    if (sw->integer){
+        p = put_varint(p, (unsigned long long)(cr->val + 0.5f));
+    }else{
+        memcpy(p, &cr->val, sizeof(float));
+        p += sizeof(float);
+    }
+    sw->len = p - sw->buf;
+    sw->last1 = cr->idx1;
+    sw->last2 = cr->idx2;
+    return 0;
+}
+
+/* Write sorted cooccurrence records, accumulating duplicate entries */
+int spill_write(spill_writer_t *sw, cooccur_t *cr, unsigned long long length){
+    if (length == 0) return 0;
+    cooccur_t old = cr[0];
+    for (unsigned long long a = 1; a < length; a++){
+        if (cr[a].idx1 == old.idx1 && cr[a].idx2 == old.idx2){
+            old.val += cr[a].val;
+            continue;
+        }
+        spill_append(sw, &old);
+        old = cr[a];
+    }
+    spill_append(sw, &old);
+    return 0;
+}
+
+/* Flush and close a spill run */
+unsigned long long spill_close_writer(spill_writer_t *sw){
+    spill_flush(sw);
+    fclose(sw->fout);
+    const unsigned long long nbytes = sw->nbytes;
+    free(sw->buf);
+    if (sw->zbuf) free(sw->zbuf);
+    free(sw);
+    return nbytes;
+}
+
+/* Open an existing spill run */
+spill_reader_t *spill_open_reader(const char *filename){
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL) return NULL;
+    char magic[sizeof(SPILL_MAGIC)];
+    unsigned char flags[2];
+    if ( fread(magic, 1, sizeof(magic), fin) != sizeof(magic)
+      || memcmp(magic, SPILL_MAGIC, sizeof(magic)) != 0
+      || fread(flags, 1, sizeof(flags), fin) != sizeof(flags) ){
+        fclose(fin);
+        throw std::runtime_error("file " + std::string(filename) + " is not a valid spill run!!");
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fileno(fin), 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    spill_reader_t *sr = (spill_reader_t*)calloc(1, sizeof(spill_reader_t));
+    sr->fin = fin;
+    sr->integer = flags[0];
+    sr->codec = flags[1];
+    sr->buf = (unsigned char*)malloc(SPILL_BLOCK_SIZE);
+    if (sr->codec == SPILL_CODEC_DEFLATE){
+        sr->zcap = compressBound(SPILL_BLOCK_SIZE);
+        sr->zbuf = (unsigned char*)malloc(sr->zcap);
+    }
+    return sr;
+}
+
+/* Open a cooccurrence file as a run */
+spill_reader_t *spill_open_cooccurrence_reader(const char *filename){
+    FILE *fin = fopen(filename, "rb");
+    if (fin == NULL) return NULL;
+    spill_reader_t *sr = (spill_reader_t*)calloc(1, sizeof(spill_reader_t));
+    csr_header_t header;
+    if (csr_read_header(fin, &header)){
+        fclose(fin);
+        sr->csr = csr_open_reader(filename);
+        return sr;
+    }
+    // flat file of raw sorted records
+    sr->fin = fin;
+    sr->raw = 1;
+    sr->buf = (unsigned char*)malloc(SPILL_BLOCK_SIZE);
+    return sr;
+}
+
+/* Read sorted records kept in memory as a run */
+spill_reader_t *spill_open_memory_reader(cooccur_t *data, const unsigned long long length){
+    spill_reader_t *sr = (spill_reader_t*)calloc(1, sizeof(spill_reader_t));
+    // a single block of raw records
+    sr->raw = 1;
+    sr->memory = 1;
+    sr->buf = (unsigned char*)data;
+    sr->len = length*sizeof(cooccur_t);
+    sr->pos = 0;
+    return sr;
+}
+
+/* ask the kernel to read the next blocks while the current one is merged,
+ * so that runs striped across several disks are read at the same time */
+static void spill_prefetch(spill_reader_t *sr){
+#ifdef POSIX_FADV_WILLNEED
+    const long offset = ftell(sr->fin);
+    if (offset < 0 || offset + SPILL_PREFETCH_SIZE/2 < sr->prefetched) return;
+    posix_fadvise(fileno(sr->fin), offset, SPILL_PREFETCH_SIZE, POSIX_FADV_WILLNEED);
+    sr->prefetched = offset + SPILL_PREFETCH_SIZE;
+#endif
+}
+
+/* load next block in memory, return 0 at the end of the run */
+static int spill_fill(spill_reader_t *sr){
+    if (sr->memory) return 0;
+    spill_prefetch(sr);
+    if (sr->raw){
+        const size_t n = fread(sr->buf, sizeof(cooccur_t), SPILL_BLOCK_SIZE/sizeof(cooccur_t), sr->fin);
+        sr->len = n*sizeof(cooccur_t);
+        sr->pos = 0;
+        return n>0;
+    }
+    unsigned int header[2];
+    if (fread(header, sizeof(unsigned int), 2, sr->fin) != 2) return 0;
+    if (header[0] > SPILL_BLOCK_SIZE){
+        throw std::runtime_error("corrupted spill run!!");
+    }
+    if (header[1] == header[0]){ // raw block
+        if (fread(sr->buf, 1, header[1], sr->fin) != header[1]){
+            throw std::runtime_error("truncated spill run!!");
+        }
+    }else{
+        if (header[1] > sr->zcap || fread(sr->zbuf, 1, header[1], sr->fin) != header[1]){
+            throw std::runtime_error("truncated spill run!!");
+        }
+        uLongf len = SPILL_BLOCK_SIZE;
+        if (uncompress(sr->buf, &len, sr->zbuf, header[1]) != Z_OK || len != header[0]){
+            throw std::runtime_error("corrupted spill run!!");
+        }
+    }
+    sr->len = header[0];
+    sr->pos = 0;
+    sr->last1 = 0;
+    sr->last2 = 0;
+    return 1;
+}
+
+/* Read next record from a spill run */
+int spill_read(spill_reader_t *sr, cooccur_t *cr){
+    if (sr->csr) return csr_read(sr->csr, cr);
+    if (sr->pos >= sr->len){
+        if (!spill_fill(sr)) return 0;
+    }
+    if (sr->raw){
+        memcpy(cr, sr->buf + sr->pos, sizeof(cooccur_t));
+        sr->pos += sizeof(cooccur_t);
+        return 1;
+    }
+    unsigned long long v;
+    const unsigned char *p = sr->buf + sr->pos;
+    p = get_varint(p, &v);
+    cr->idx1 = sr->last1 + (unsigned int)v;
+    p = get_varint(p, &v);
+    cr->idx2 = (cr->idx1 == sr->last1) ? sr->last2 + (unsigned int)v : (unsigned int)v;
+    if (sr->integer){
+        p = get_varint(p, &v);
+        cr->val = (float)v;
+    }else{
+        memcpy(&cr->val, p, sizeof(float));
+        p += sizeof(float);
+    }
+    sr->pos = p - sr->buf;
+    sr->last1 = cr->idx1;
+    sr->last2 = cr->idx2;
+    return 1;
+}
+
+/* add the next record of the i-th run to the priority queue */
+static void spill_next(spill_reader_t **runs, const int i, cooccur_id_t *pq, int *size){
+    cooccur_t record;
+    if (runs[i] == NULL || !spill_read(runs[i], &record)) return; // skip empty runs
+    cooccur_id_t new_id;
+    new_id.idx1 = record.idx1; new_id.idx2 = record.idx2; new_id.val = record.val;
+    new_id.id = i;
+    insert_pq(pq, new_id, ++(*size));
+}
+
+/* state of a merge with mirrors waiting for their row in a priority queue of their own */
+struct spill_merger {
+    spill_reader_t **runs;
+    int num;
+    cooccur_id_t *pq;
+    int size;
+    spill_mirror_t *mirror;
+    cooccur_id_t *pending;
+    int npending;
+    int capacity;
+};
+
+/* whether the smallest record left is a mirror */
+static inline int spill_pending_first(const spill_merger *m){
+    return m->npending > 0 && (m->size == 0 || compare_id(m->pending[0], m->pq[0]) < 0);
+}
+
+/* get the smallest record left, either from the runs or from the mirrors, 0 once every run has reached its end */
+static int spill_peek(const spill_merger *m, cooccur_id_t *top){
+    if (spill_pending_first(m)) *top = m->pending[0];
+    else if (m->size > 0) *top = m->pq[0];
+    else return 0;
+    return 1;
+}
+
+/* remove the smallest record left, see spill_peek() */
+static int spill_pop(spill_merger *m, cooccur_id_t *top){
+    if (spill_pending_first(m)){
+        *top = m->pending[0];
+        delete_pq(m->pending, m->npending--);
+        return 1;
+    }
+    if (m->size == 0) return 0;
+    *top = m->pq[0];
+    delete_pq(m->pq, m->size--);
+    spill_next(m->runs, top->id, m->pq, &m->size);
+    return 1;
+}
+
+/* write the mirrors held in memory as a new run, to be merged with the others */
+static void spill_mirrors(spill_merger *m){
+    char filename[MAX_FULLPATH_NAME];
+    snprintf(filename, sizeof(filename), "%s_%04d.bin", m->mirror->prefix, m->num);
+    spill_writer_t *sw = spill_open_writer(filename, m->mirror->integer, m->mirror->codec);
+    if (sw == NULL) throw std::runtime_error("Unable to create file " + std::string(filename) + " !!");
+    cooccur_id_t old = m->pending[0];
+    delete_pq(m->pending, m->npending--);
+    while (m->npending > 0){
+        if (m->pending[0].idx1 == old.idx1 && m->pending[0].idx2 == old.idx2) old.val += m->pending[0].val;
+        else{
+            spill_append(sw, (cooccur_t*)&old);
+            old = m->pending[0];
+        }
+        delete_pq(m->pending, m->npending--);
+    }
+    spill_append(sw, (cooccur_t*)&old);
+    spill_close_writer(sw);
+    m->runs = (spill_reader_t**)realloc(m->runs, (m->num+1) * sizeof(spill_reader_t*));
+    m->pq = (cooccur_id_t*)realloc(m->pq, (m->num+1) * sizeof(cooccur_id_t));
+    m->runs[m->num] = spill_open_reader(filename);
+    spill_next(m->runs, m->num++, m->pq, &m->size);
+}
+
+/* write a merged record, the part of its value from the runs to be mirrored is added to its mirror */
+static void spill_emit(spill_merger *m, cooccur_id_t *record, const int mirrored, const float sym, csr_writer_t *cw, spill_writer_t *sw, int *tokenfound){
+    cooccur_t mirror;
+    if (mirrored && m->mirror->mirror((cooccur_t*)record, &mirror)){
+        if (mirror.idx1 == record->idx1 && mirror.idx2 == record->idx2) record->val += sym; // its own mirror
+        else{
+            if (m->npending == m->capacity) spill_mirrors(m);
+            cooccur_id_t new_id;
+            new_id.idx1 = mirror.idx1; new_id.idx2 = mirror.idx2; new_id.val = sym;
+            new_id.id = -1;
+            insert_pq(m->pending, new_id, ++m->npending);
+        }
+    }
+    if (tokenfound) tokenfound[record->idx1]=1; // set this token has found
+    if (sw) spill_append(sw, (cooccur_t*)record);
+    else csr_append(cw, (cooccur_t*)record);
+}
+
+/* Merge sorted runs, accumulating duplicate entries */
+unsigned long long spill_merge(spill_reader_t **runs, const int num, csr_writer_t *cw, spill_writer_t *sw, int *tokenfound, spill_mirror_t *mirror, const int verbose){
+    unsigned long long counter = 0;
+    spill_merger m;
+    m.runs = (spill_reader_t**)malloc(num * sizeof(spill_reader_t*));
+    memcpy(m.runs, runs, num * sizeof(spill_reader_t*));
+    m.num = num;
+    m.pq = (cooccur_id_t*)malloc(num * sizeof(cooccur_id_t));
+    m.size = 0;
+    m.mirror = mirror;
+    m.npending = 0;
+    m.capacity = (mirror == NULL) ? 0 : (mirror->capacity < (1ULL<<30)) ? (int)mirror->capacity : (1<<30);
+    if (m.capacity < 1 && mirror != NULL) m.capacity = 1;
+    m.pending = (m.capacity > 0) ? (cooccur_id_t*)malloc(m.capacity * sizeof(cooccur_id_t)) : NULL;
+    if (m.capacity > 0 && m.pending == NULL){
+        throw std::runtime_error("cannot allocate mirror buffer, try a lower -memory value !!");
+    }
+    cooccur_id_t old_id, top;
+
+    /* add first entry of each run to priority queue */
+    for (int i=0; i<num; i++) spill_next(m.runs, i, m.pq, &m.size);
+
+    /* Pop top node, save it in old to see if the next entry is a duplicate,
+     * with the part of its value to be mirrored */
+    if (spill_pop(&m, &old_id)){
+        int mirrored = mirror && old_id.id >= mirror->first && old_id.id < num;
+        float sym = (mirrored) ? old_id.val : 0;
+
+        /* Repeatedly pop top node and fill priority queue until runs have reached their end,
+         * the next node is only popped once the previous one is written, as its mirror may come first */
+        while (spill_peek(&m, &top)){
+            if (top.idx1 != old_id.idx1 || top.idx2 != old_id.idx2){
+                spill_emit(&m, &old_id, mirrored, sym, cw, sw, tokenfound);
+                spill_pop(&m, &old_id);
+                mirrored = mirror && old_id.id >= mirror->first && old_id.id < num;
+                sym = (mirrored) ? old_id.val : 0;
+                // Only count the records written to file, not duplicates
+                if((++counter%100000) == 0) if(verbose) fprintf(stderr,"\033[65G%llu cooccurrences.",counter);
+            }else{
+                spill_pop(&m, &top);
+                old_id.val += top.val;
+                if (mirror && top.id >= mirror->first && top.id < num){
+                    sym += top.val;
+                    mirrored = 1;
+                }
+            }
+        }
+        spill_emit(&m, &old_id, mirrored, sym, cw, sw, tokenfound);
+        counter++;
+    }
+
+    /* spilled mirrors are only needed by this merge */
+    for (int i=num; i<m.num; i++){
+        char filename[MAX_FULLPATH_NAME];
+        snprintf(filename, sizeof(filename), "%s_%04d.bin", mirror->prefix, i);
+        spill_close_reader(m.runs[i]);
+        remove(filename);
+    }
+    free(m.runs);
+    free(m.pq);
+    free(m.pending);
+
+    return counter;
+}
+
+/* Close a spill run */
+void spill_close_reader(spill_reader_t *sr){
+    if (sr->csr){
+        csr_close_reader(sr->csr);
+        free(sr);
+        return;
+    }
+    if (sr->memory){ // records belong to the caller
+        free(sr);
+        return;
+    }
+    fclose(sr->fin);
+    free(sr->buf);
+    if (sr->zbuf) free(sr->zbuf);
+    free(sr);
+}
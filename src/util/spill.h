@@ -0,0 +1,219 @@
+// Compressed spill runs of cooccurrence records
+//
+// Copyright (c) 2015 Idiap Research Institute, http://www.idiap.ch/
+// Written by Rémi Lebret <remi@lebret.ch>
+//
+// This file is part of HPCA.
+//
+// HPCA is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License version 3 as
+// published by the Free Software Foundation.
+//
+// HPCA is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with HPCA. If not, see <http://www.gnu.org/licenses/>.
+
+/**
+ * @file       spill.h
+ * @author     Remi Lebret
+ * @brief      compressed spill runs of cooccurrence records
+ *
+ * A spill run is a sorted sequence of @c cooccur_t records written in blocks.
+ * Within a block, @c idx1 is delta-encoded as a varint, @c idx2 is
+ * delta-encoded against the previous record of the same row, and values are
+ * stored either as varint counts (integer mode) or as raw floats.
+ * Blocks can optionally be deflated with the fastest zlib level.
+ */
+
+#ifndef SPILL_H_
+#define SPILL_H_
+
+// C header
+#include <stdio.h>
+
+#include "data.h"
+#include "csr.h"
+
+/**
+ * 	@ingroup Utility
+ * 	@{
+ */
+
+/* codec applied on each encoded block */
+#define SPILL_CODEC_NONE    0
+#define SPILL_CODEC_DEFLATE 1
+
+/* size of an encoded block before compression */
+#define SPILL_BLOCK_SIZE    1048576
+
+/* number of bytes read ahead of the current block */
+#define SPILL_PREFETCH_SIZE (4*SPILL_BLOCK_SIZE)
+
+/**
+ * 	@struct spill_writer_t
+ *
+ *	@brief writer of a compressed spill run
+ */
+struct spill_writer {
+    FILE *fout;
+    int integer;
+    int codec;
+    unsigned char *buf;
+    size_t len;
+    unsigned char *zbuf;
+    size_t zcap;
+    unsigned int last1;
+    unsigned int last2;
+    unsigned long long nbytes;
+};
+typedef spill_writer spill_writer_t;
+
+/**
+ * 	@struct spill_reader_t
+ *
+ *	@brief reader of a compressed spill run
+ */
+struct spill_reader {
+    FILE *fin;
+    csr_reader_t *csr;
+    int raw;
+    int memory;
+    int integer;
+    int codec;
+    unsigned char *buf;
+    size_t len;
+    size_t pos;
+    unsigned char *zbuf;
+    size_t zcap;
+    unsigned int last1;
+    unsigned int last2;
+    long prefetched; // end of the bytes already read ahead
+};
+typedef spill_reader spill_reader_t;
+
+/**
+ * 	@struct spill_mirror_t
+ *
+ *	@brief mirrors of the records of some runs, added while merging them
+ *
+ * Mirrors must fall in a later row than their record. They wait in memory
+ * for their row, and are spilled as new runs when the memory is full.
+ */
+struct spill_mirror {
+    int (*mirror)(const cooccur_t *record, cooccur_t *mirrored); // 0 if the record has no mirror
+    int first; // runs from this one on hold records to be mirrored
+    unsigned long long capacity; // number of mirrors held in memory
+    const char *prefix; // spilled mirrors are named <prefix>_####.bin
+    int integer;
+    int codec;
+};
+typedef spill_mirror spill_mirror_t;
+
+/**
+ * @brief Create a new spill run
+ *
+ * @param filename the file name
+ * @param integer whether values are integer counts
+ * @param codec block codec (@c SPILL_CODEC_NONE or @c SPILL_CODEC_DEFLATE)
+ * @return the writer
+ **/
+spill_writer_t *spill_open_writer(const char *filename, const int integer, const int codec);
+
+/**
+ * @brief Write sorted cooccurrence records, accumulating duplicate entries
+ *
+ * @param sw the writer
+ * @param cr pointer to sorted @c cooccur_t records
+ * @param length number of records
+ **/
+int spill_write(spill_writer_t *sw, cooccur_t *cr, unsigned long long length);
+
+/**
+ * @brief Append a single record to the run
+ *
+ * Records must be appended in increasing (idx1, idx2) order.
+ *
+ * @param sw the writer
+ * @param cr the record
+ **/
+int spill_append(spill_writer_t *sw, const cooccur_t *cr);
+
+/**
+ * @brief Flush and close a spill run
+ *
+ * @param sw the writer
+ * @return the number of bytes written on disk
+ **/
+unsigned long long spill_close_writer(spill_writer_t *sw);
+
+/**
+ * @brief Open an existing spill run
+ *
+ * @param filename the file name
+ * @return the reader, NULL if the file cannot be opened
+ **/
+spill_reader_t *spill_open_reader(const char *filename);
+
+/**
+ * @brief Open a cooccurrence file as a run
+ *
+ * Both CSR files and flat files of sorted @c cooccur_t records are read.
+ *
+ * @param filename the file name
+ * @return the reader, NULL if the file cannot be opened
+ **/
+spill_reader_t *spill_open_cooccurrence_reader(const char *filename);
+
+/**
+ * @brief Read sorted records kept in memory as a run
+ *
+ * @param data the records, sorted, which must outlive the reader
+ * @param length number of records
+ * @return the reader
+ **/
+spill_reader_t *spill_open_memory_reader(cooccur_t *data, const unsigned long long length);
+
+/**
+ * @brief Read next record from a spill run
+ *
+ * @param sr the reader
+ * @param cr where to store the record
+ * @return 1 if a record has been read, 0 at the end of the run
+ **/
+int spill_read(spill_reader_t *sr, cooccur_t *cr);
+
+/**
+ * @brief Merge sorted runs, accumulating duplicate entries
+ *
+ * Records are appended either to the CSR matrix @p cw,
+ * or to the spill run @p sw when it is not NULL.
+ *
+ * With @p mirror, the accumulated value coming from the runs to be mirrored
+ * is also added to the mirror of each record, itself once more for a
+ * record which is its own mirror.
+ *
+ * @param runs the runs to merge, empty or NULL runs are skipped
+ * @param num number of runs
+ * @param cw output CSR matrix
+ * @param sw output spill run
+ * @param tokenfound if not NULL, set to 1 for every row found
+ * @param mirror if not NULL, mirrors added to the records
+ * @param verbose print out progress
+ * @return the number of records written, 0 if every run is empty
+ **/
+unsigned long long spill_merge(spill_reader_t **runs, const int num, csr_writer_t *cw, spill_writer_t *sw, int *tokenfound, spill_mirror_t *mirror, const int verbose);
+
+/**
+ * @brief Close a spill run
+ *
+ * @param sr the reader
+ **/
+void spill_close_reader(spill_reader_t *sr);
+
+/** @} */
+
+#endif /* SPILL_H_ */
@@ -136,7 +136,7 @@ void MultiThread::linear( void* (*run)( void*) )
   {
     // number of variables in each thread
     // define remaining elements
-    int rm = nb_element_;
+    long int rm = nb_element_;
     // add the start and the end of each data block
     for (int i=0; i<nb_thread_; i++)
     {
@@ -38,6 +38,7 @@ extern "C"
 #else
   #include <sys/types.h>  // For stat().
   #include <sys/sysinfo.h>
+  #include <unistd.h>     // For sysconf().
 #endif
 }
 
@@ -72,6 +73,23 @@ bool is_file(const char * path){
     }else return true;
 }
 
+/* create a directory if it does not exist */
+bool create_directory( const char * path ){
+    struct stat status;
+    if ( stat( path, &status ) == 0 ) return is_directory( path );
+    if ( mkdir( path, 0755 ) != 0 ){
+        throw std::runtime_error("Cannot create directory: " + std::string(path) + "\n");
+    }
+    return true;
+}
+
+/* get file byte size */
+unsigned long long get_file_size(const char * path){
+    struct stat status;
+    if ( stat( path, &status ) != 0 ) return 0;
+    return status.st_size;
+}
+
 /* get file full path */
 char* const get_full_path(const char *dir, const char *filename){
   char *output_filename = (char*)malloc(strlen(dir)+strlen(filename)+2);
@@ -232,6 +250,41 @@ unsigned long long int get_available_memory()
 #endif
 }
 
+// get the resident memory of the current process
+unsigned long long int get_process_memory()
+{
+#ifdef __linux
+    unsigned long long size=0, resident=0;
+    FILE *fp = fopen("/proc/self/statm", "r");
+    if (fp == NULL) return 0;
+    if (fscanf(fp, "%llu %llu", &size, &resident) != 2) resident = 0;
+    fclose(fp);
+    return resident * sysconf(_SC_PAGESIZE);
+#else
+    return 0;
+#endif
+}
+
+// get the memory limit of the control group, 0 if there is none
+unsigned long long int get_cgroup_memory_limit()
+{
+#ifdef __linux
+    const char *files[2] = {"/sys/fs/cgroup/memory.max", // cgroup v2
+                            "/sys/fs/cgroup/memory/memory.limit_in_bytes"}; // cgroup v1
+    for (int i=0; i<2; i++){
+        FILE *fp = fopen(files[i], "r");
+        if (fp == NULL) continue;
+        unsigned long long limit=0;
+        const int found = fscanf(fp, "%llu", &limit);
+        fclose(fp);
+        // "max" or a huge value stand for no limit
+        if (found != 1 || limit >= (1ULL << 60)) return 0;
+        return limit;
+    }
+#endif
+    return 0;
+}
+
 // get a line in a file
 char * get_next_line (FILE * stream)
 {
@@ -321,8 +374,7 @@ char * get_next_gzline ( gzFile stream )
 // Reads a single word from a file, assuming space + tab + EOL to be word boundaries
 int get_next_word(char *word, FILE *stream) {
   int a = 0, ch;
-  while (!feof(stream)) {
-    ch = fgetc(stream);
+  while ((ch = fgetc(stream)) != EOF) {
     if (ch == 13) continue;
     if ((ch == ' ') || (ch == '\t') || (ch == '\n')) {
       if (a > 0) {
@@ -338,7 +390,7 @@ int get_next_word(char *word, FILE *stream) {
     if (a >= MAX_TOKEN - 1) a--;   // Truncate too long words
   }
   word[a] = 0;
-  return 1;
+  return (a > 0);  // nothing left at the end of file
 }
 
 // Reads a single word from a file, assuming space + tab + EOL to be word boundaries
@@ -362,7 +414,7 @@ int get_next_gzword(char *word, gzFile stream) {
     if (a >= MAX_TOKEN - 1) a--;   // Truncate too long words
   }
   word[a] = 0;
-  return 1;
+  return (a > 0);  // nothing left at the end of file
 }
 
 
@@ -459,6 +511,60 @@ std::string remove_first_characters( const std::string & Str, char C )
        Str.find_first_not_of( C ) );
 }
 
+// read KEY=VALUE options file
+std::map<std::string, std::string> read_options( const char * filename )
+{
+    std::map<std::string, std::string> options;
+    std::ifstream ifs( filename );
+    if ( ifs.fail() ){
+        throw std::runtime_error("Cannot find file " + std::string(filename) + " !!!\n");
+    }
+    std::string line;
+    while ( getline(ifs, line) ){
+        if ( line.empty() || line[0] == '#' ) continue;
+        const size_t eq = line.find('=');
+        if ( eq == std::string::npos ) continue;
+        options[line.substr(0, eq)] = line.substr(eq+1);
+    }
+    return options;
+}
+
+// compute the CRC-32 of a file content
+unsigned long file_crc32( const char * filename )
+{
+    FILE *fp = fopen(filename, "rb");
+    if ( fp == NULL ){
+        throw std::runtime_error("Cannot find file " + std::string(filename) + " !!!\n");
+    }
+    unsigned char buffer[65536];
+    unsigned long crc = crc32(0L, Z_NULL, 0);
+    size_t n;
+    while ( (n = fread(buffer, 1, sizeof(buffer), fp)) > 0 ) crc = crc32(crc, buffer, n);
+    fclose(fp);
+    return crc;
+}
+
+// split a string according to a delimiter
+std::vector<std::string> split( const std::string & str, char delim )
+{
+    std::vector<std::string> items;
+    std::istringstream iss(str);
+    std::string item;
+    while ( getline(iss, item, delim) ){
+        if (!item.empty()) items.push_back(item);
+    }
+    return items;
+}
+
+// split a comma-separated list of integers
+std::vector<int> split_int( const char * str )
+{
+    std::vector<std::string> items = split(std::string(str), ',');
+    std::vector<int> values;
+    for (size_t i=0; i<items.size(); i++) values.push_back(atoi(items[i].c_str()));
+    return values;
+}
+
 // find arguments from options in command line
 int find_arg(char *str, int argc, char **argv) {
     int i;
@@ -28,6 +28,8 @@
 
 // C++ header
 #include <string>
+#include <vector>
+#include <map>
 #include <cstdio>
 #include <zlib.h>
 
@@ -51,6 +53,22 @@ bool is_directory( const char * path );
  */
 bool is_file(const char * path );
 
+/**
+ * 	@brief Create a directory if it does not exist yet
+ *
+ *  @param path the path
+ *  @return a boolean
+ */
+bool create_directory( const char * path );
+
+/**
+ * 	@brief Return the byte size of a file
+ *
+ *  @param path the path
+ *  @return the size, 0 if the file does not exist
+ */
+unsigned long long get_file_size(const char * path);
+
 /**
  * 	@brief Return full path of a file
  *
@@ -81,6 +99,20 @@ const unsigned long long int get_total_swap();
  */
 unsigned long long int get_available_memory();
 
+/**
+ *  @brief Accessor
+ *
+ *  Get the resident memory of the current process, 0 if unknown
+ */
+unsigned long long int get_process_memory();
+
+/**
+ *  @brief Accessor
+ *
+ *  Get the memory limit of the control group of the process, 0 if there is none
+ */
+unsigned long long int get_cgroup_memory_limit();
+
 /**
  * 	@brief Read a line in a file
  *
@@ -102,7 +134,7 @@ char * get_next_gzline ( gzFile stream );
  *
  *  @param word where to store the output word
  * 	@param stream the output stream
- *  @return 0 if end of line, 1 otherwise
+ *  @return 0 if end of line or end of file, 1 otherwise
  */
 int get_next_word( char * word, FILE * stream );
 
@@ -111,7 +143,7 @@ int get_next_word( char * word, FILE * stream );
  *
  *  @param word where to store the output word
  *  @param stream the output stream
- *  @return 0 if end of line, 1 otherwise
+ *  @return 0 if end of line or end of file, 1 otherwise
  */
 int get_next_gzword ( char * word, gzFile stream );
 
@@ -166,6 +198,39 @@ void remove_all_characters( std::string & Str, char C );
 std::string remove_first_characters( const std::string & Str, char C );
 
 
+/**
+ *  @brief Read a file of KEY=VALUE options, such as options.txt
+ *
+ *  @param filename the file name
+ *  @return the options, comments are skipped
+ */
+std::map<std::string, std::string> read_options( const char * filename );
+
+/**
+ *  @brief Compute the CRC-32 checksum of a file content
+ *
+ *  @param filename the file name
+ *  @return the checksum
+ */
+unsigned long file_crc32( const char * filename );
+
+/**
+ *  @brief Split a string according to a delimiter
+ *
+ *  @param str the input
+ *  @param delim the delimiter
+ *  @return the non-empty items
+ */
+std::vector<std::string> split( const std::string & str, char delim );
+
+/**
+ *  @brief Split a comma-separated list of integers
+ *
+ *  @param str the input
+ *  @return the integers
+ */
+std::vector<int> split_int( const char * str );
+
 /**
  *  @brief Find arguments from options in command line
  *
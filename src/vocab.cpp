@@ -44,7 +44,7 @@ int writevocab(vocab *hash, std::string output_file_name){
 
     if (verbose) fprintf(stderr, "Writing vocabulary file in %s\n", output_file_name.c_str());
     // get vocab full size
-    const int size = hash->size();
+    const size_t size = hash->size();
     // sorting by value (descending order)
     const entry_t *sorted_hash = hash_sort(hash);
 
@@ -56,8 +56,8 @@ int writevocab(vocab *hash, std::string output_file_name){
                             + std::string(" !!!");
       throw std::runtime_error(error_msg);
     }
-    for (int i=0; i<size; i++)
-      fprintf(fout, "%s %d\n", sorted_hash[i].key, sorted_hash[i].value);
+    for (size_t i=0; i<size; i++)
+      fprintf(fout, "%s %llu\n", sorted_hash[i].key, sorted_hash[i].value);
     fclose(fout);
 
     if(verbose) fprintf(stderr,"Counted %ld unique words.\n", hash->size());
@@ -75,7 +75,7 @@ void *getvocab( void *p ){
     Thread* thread = (Thread*)p;
     const long int start = thread->start();
     const long int end = thread->end();
-    const long int nbop = (end-start)/100;
+    const long int nbop = (((end==FILE_END) ? File(std::string(c_input_file_name)).size() : end)-start)/100;
     // get output file name
     std::string output_file_name = std::string(c_vocab_file_name);
 
@@ -102,7 +102,7 @@ void *getvocab( void *p ){
     long int position=input_file.position();
     int itr=0;
     if (verbose) loadbar(thread->id(), itr, 100);
-    while ( position<end ){
+    while ( position<end && !input_file.eof() ){
         // get next word
         while (input_file.getword(word)){
             hash[word]++;
@@ -123,7 +123,7 @@ void *getvocab( void *p ){
     if ( thread->id()!= -1 ){
         long long *ptr_ntokens = (long long *) thread->object;
         // increment total number of tokens
-        (*ptr_ntokens) += ntokens;
+        __atomic_fetch_add(ptr_ntokens, ntokens, __ATOMIC_RELAXED);
         // write hash table
         hash_print(&hash, output_file_name.c_str());
         // existing pthread
@@ -146,7 +146,7 @@ int merge(const int nthreads){
     vocab hash;
 
     char token[MAX_TOKEN];
-    int freq;
+    unsigned long long freq;
     char temp_hash_file[MAX_FULLPATH_NAME];
     // loop over pthread
     for (int t=0; t<nthreads; t++){
@@ -158,7 +158,7 @@ int merge(const int nthreads){
             + std::string(" !!!\n");
             throw std::runtime_error(error_msg);
         }
-        while(fscanf(fp, "%s %d\n", token, &freq) != EOF){
+        while(fscanf(fp, "%s %llu\n", token, &freq) != EOF){
             //hash.insert(token, freq);
             hash[token]+=freq;
         }
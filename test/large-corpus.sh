@@ -0,0 +1,26 @@
+#!/bin/bash
+#
+# vocab over a synthetic gzipped corpus of more than 2^32 tokens:
+# word counts beyond 32 bits, byte offsets beyond 4GB and a gzip trailer
+# which no longer gives the uncompressed size
+#
+# usage: large-corpus.sh <binary dir> <working dir>
+
+set -e
+BIN_DIR=$1
+WORK_DIR=$2
+mkdir -p $WORK_DIR
+cd $WORK_DIR
+
+# one gzip member of 10^8 tokens, concatenated 43 times
+LINE=$(printf 'a %.0s' $(seq 99))a
+yes "$LINE" | head -n 1000000 | gzip -1 > member.gz
+rm -f corpus.gz
+for i in $(seq 43); do cat member.gz >> corpus.gz; done
+rm -f member.gz
+
+$BIN_DIR/vocab -input-file corpus.gz -vocab-file vocab.txt -threads 4 -verbose 1 > vocab.log 2>&1
+rm -f corpus.gz
+
+grep -q "done after reading 4300000000 tokens" vocab.log
+grep -qx "a 4300000000" vocab.txt